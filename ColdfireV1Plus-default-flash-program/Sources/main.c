@@ -30,6 +30,15 @@ extern uint8_t _vect[];
 #endif
 #define SOPT_ADDRESS                    ((uint8_t *) NULL)
 
+// Programming acceleration RAM (FlexRAM) used by F_PGMSEC
+#define FLEXRAM_ADDRESS                 ((uint32_t *)(0x00280000))
+#define FLEXRAM_SIZE                    (2*(1<<10))
+
+// Flash blocks (FTFL addresses - A23 selects FlexNVM)
+#define FLASH_BLOCK_ADDRESS_A23         (1UL<<23)
+#define PFLASH_BLOCK_SIZE               (128*(1<<10))
+#define DFLASH_BLOCK_SIZE               (32*(1<<10))
+
 // Cache control uses CPUCR
 
 #pragma pack(1)
@@ -99,6 +108,8 @@ typedef struct {
 #define DO_VERIFY_RANGE       (1<<5) // Verify range
 #define DO_PARTITION_FLEXNVM  (1<<7) // Program FlexNVM DFLASH/EEPROM partitioning
 #define DO_TIMING_LOOP        (1<<8) // Counting loop to determine clock speed
+#define DO_FILL_RANGE         (1<<11) // Program range with FlashData_t.fillPattern (no data transferred)
+#define DO_RECORD_COUNTERS    (1<<14) // Record performance counters in FlashData_t
 
 #define IS_COMPLETE           (1<<31)
                              
@@ -110,7 +121,10 @@ typedef struct {
 #define CAP_VERIFY_RANGE       (1<<5)
 #define CAP_PARTITION_FLEXNVM  (1<<7)
 #define CAP_TIMING             (1<<8)
+#define CAP_FILL_RANGE         (1<<9)
+#define CAP_RECORD_COUNTERS    (1<<14)
 
+#define CAP_HEADER_V2          (1<<10) // Indicates FlashProgramHeader_t.info is valid
 #define CAP_DSC_OVERLAY        (1<<11) // Indicates DSC code in pMEM overlays xRAM
 #define CAP_DATA_FIXED         (1<<12) // Indicates TargetFlashDataHeader is at fixed address
                                
@@ -140,8 +154,23 @@ typedef enum {
 // This is the smallest unit of Flash that can be erased
 #define FLASH_SECTOR_SIZE  (1*(1<<10)) // 1K block size (used for stride in erase)
 
+// Largest section programmed by a single F_PGMSEC command
+#define SECTION_SIZE       (FLEXRAM_SIZE/2)
+
+// Size of buffer programmed repeatedly by fillRange() (DO_FILL_RANGE)
+#define FILL_CHUNK_SIZE (32)
+
 typedef void (*EntryPoint_t)(void);
 #pragma pack(2)
+// Performance counters (only written if DO_RECORD_COUNTERS)
+typedef struct {
+   uint32_t         eraseTicks;        // Status polls while erasing
+   uint32_t         blankCheckTicks;   // Status polls while blank checking
+   uint32_t         programTicks;      // Status polls while programming
+   uint32_t         verifyTicks;       // Status polls while verifying
+   uint32_t         programSkipped;    // Program commands skipped as data was all erased value
+} FlashCounters_t;
+
 // Describes a block to be programmed & result
 typedef struct {
    uint32_t         flags;             // Controls actions of routine
@@ -153,14 +182,50 @@ typedef struct {
    uint32_t         address;           // Memory address being accessed
    uint32_t         size;              // Size of memory range being accessed
    const uint32_t  *data;              // Ptr to data to program
+   FlashCounters_t  counters;          // Performance counters (only if DO_RECORD_COUNTERS)
+   uint32_t         fillPattern[2];    // Pattern repeated over range (only if DO_FILL_RANGE)
 } FlashData_t;
 
+//==========================================================================================================
+// Information records (CAP_HEADER_V2)
+//
+// FlashProgramHeader_t.info points to a list of tag/length/value records terminated by INFO_END.
+// Values are in target byte order.  Records with unknown tags should be skipped using length.
+//
+#define HEADER_VERSION       (2)
+
+#define INFO_END             (0) // End of list
+#define INFO_VERSION         (1) // Header version (HEADER_VERSION)
+#define INFO_PHRASE_SIZE     (2) // Minimum program unit (bytes)
+#define INFO_SECTOR_SIZE     (3) // Minimum erase unit (bytes)
+#define INFO_BUFFER_ADDRESS  (4) // First free location after image (suitable for data buffer)
+#define INFO_BUFFER_SIZE     (5) // Largest dataSize accepted by a single call (bytes)
+#define INFO_OPERATIONS      (6) // Supported operations (CAP_xxx mask)
+#define INFO_CLOCK           (7) // Clock requirement (INFO_CLOCK_xxx or assumed bus clock in kHz)
+#define INFO_ENDIAN          (8) // Byte order (INFO_ENDIAN_xxx)
+#define INFO_ADDRESS_UNIT    (9) // Size of addressable unit (bytes)
+
+#define INFO_CLOCK_NONE      (0)            // Flash controller needs no clock set-up
+#define INFO_CLOCK_FREQUENCY (0xFFFFFFFFUL) // Flash clock divider is calculated from flashData->frequency
+#define INFO_CLOCK_HOST      (0xFFFFFFFEUL) // Flash clock divider must be set by host
+
+#define INFO_ENDIAN_LITTLE   (0)
+#define INFO_ENDIAN_BIG      (1)
+
+//! Information record
+typedef struct {
+   uint16_t         tag;               // Type of record (INFO_xxx)
+   uint16_t         length;            // Size of value (bytes)
+   uint32_t         value;             // Value
+} FlashInfoRecord_t;
+
 //! Describe the flash programming code
 typedef struct {
    uint32_t         loadAddress;       // Address where to load this image
    EntryPoint_t     entry;             // Ptr to entry routine
    uint32_t         capabilities;      // Capabilities of routine
    FlashData_t     *flashData;         // Ptr to information about operation
+   const FlashInfoRecord_t *info;      // Ptr to information records (CAP_HEADER_V2)
 } FlashProgramHeader_t;
 
 #pragma pack(0)
@@ -169,20 +234,40 @@ asm void asm_entry(void);
 
 #pragma define_section flashProgramHeader ".text" far_absolute R
 
+#define CAPABILITIES (CAP_BLANK_CHECK_RANGE|CAP_ERASE_RANGE|CAP_ERASE_BLOCK|CAP_PROGRAM_RANGE|\
+                      CAP_VERIFY_RANGE|CAP_PARTITION_FLEXNVM|CAP_RECORD_COUNTERS|CAP_HEADER_V2|CAP_FILL_RANGE)
+
+//! Information records describing this routine
+//!
+const FlashInfoRecord_t flashInfo[] = {
+     {INFO_VERSION,        4, HEADER_VERSION},
+     {INFO_PHRASE_SIZE,    4, 4},
+     {INFO_BUFFER_SIZE,    4, 0xFFFFFFFFUL},
+     {INFO_OPERATIONS,     4, CAPABILITIES},
+     {INFO_CLOCK,          4, INFO_CLOCK_NONE},
+     {INFO_ENDIAN,         4, INFO_ENDIAN_BIG},
+     {INFO_ADDRESS_UNIT,   4, 1},
+     {INFO_END,            0, 0},
+};
+
 //! Flash programming command table
 //!
 __declspec(flashProgramHeader) 
 const FlashProgramHeader_t gFlashProgramHeader = {
      /* loadAddress  */ 0x00800000,        // load address of image
      /* entry        */ asm_entry,         // entry point for code
-     /* capabilities */ CAP_BLANK_CHECK_RANGE|CAP_ERASE_RANGE|CAP_ERASE_BLOCK|CAP_PROGRAM_RANGE|CAP_VERIFY_RANGE|CAP_PARTITION_FLEXNVM,
-     /* flashData    */ NULL
+     /* capabilities */ CAPABILITIES,
+     /* flashData    */ NULL,
+     /* info         */ flashInfo,
 };
 
 void setErrorCode(int errorCode);
+void initCounters(FlashData_t *flashData);
+void startPhase(FlashData_t *flashData, uint32_t *counter);
 void initFlash(FlashData_t *flashData);
 void eraseFlashBlock(FlashData_t *flashData);
 void programRange(FlashData_t *flashData);
+void fillRange(FlashData_t *flashData);
 void verifyRange(FlashData_t *flashData);
 void eraseRange(FlashData_t *flashData);
 void blankCheckRange(FlashData_t *flashData);
@@ -193,6 +278,38 @@ void testApp(void);
 asm void asm_testApp(void);
 int executeCommand(FlashController *controller);
 
+//==========================================================================================================
+// Performance counters (DO_RECORD_COUNTERS)
+//
+//  There is no free-running timer available so each phase is timed in flash status
+//  polling iterations, similar to the timing loop count.  Phases that do not wait on
+//  the flash controller (blank check, verify) will record 0.
+//
+static uint32_t *phaseCounter;   // Counter for phase in progress
+static uint32_t  discardTicks;   // Used when not recording
+
+//! Clear counters and select which counter polls are accumulated into
+//!
+void initCounters(FlashData_t *flashData) {
+   phaseCounter = &discardTicks;
+   if ((flashData->flags&DO_RECORD_COUNTERS) == 0) {
+      return;
+   }
+   flashData->counters.eraseTicks      = 0;
+   flashData->counters.blankCheckTicks = 0;
+   flashData->counters.programTicks    = 0;
+   flashData->counters.verifyTicks     = 0;
+   flashData->counters.programSkipped  = 0;
+}
+
+//! Start accumulating polls into a new counter
+//!
+void startPhase(FlashData_t *flashData, uint32_t *counter) {
+   if ((flashData->flags&DO_RECORD_COUNTERS) != 0) {
+      phaseCounter = counter;
+   }
+}
+
 //! Set error code to return to BDM & halt
 //!
 void setErrorCode(int errorCode) {
@@ -229,6 +346,7 @@ int executeCommand(FlashController *controller) {
 
    // Wait for command complete
    while ((controller->fstat & FTFL_FSTAT_CCIF) == 0) {
+      (*phaseCounter)++;
    }
    // Convert error codes
    if ((controller->fstat & FTFL_FSTAT_FPVIOL ) != 0) {
@@ -263,6 +381,10 @@ void eraseFlashBlock(FlashData_t *flashData) {
 
 //! Program a range of flash from buffer
 //!
+//! Uses F_PGMSEC via the programming acceleration RAM (FlexRAM) when it is 
+//! available as RAM otherwise programs individual longwords.
+//! Sections do not cross a sector boundary.
+//!
 //! Returns an error if the security location is to be programmed
 //! to permanently lock the device
 //!
@@ -271,6 +393,7 @@ void programRange(FlashData_t *flashData) {
    uint32_t         address    = flashData->address;
    const uint32_t  *data       = flashData->data;
    uint32_t         numWords   = flashData->size/4;
+   uint32_t         skipped    = 0;
    int              rc         = FLASH_ERR_OK;
    
    if ((flashData->flags&DO_PROGRAM_RANGE) == 0) {
@@ -279,26 +402,116 @@ void programRange(FlashData_t *flashData) {
    if ((address & 0x03) != 0) {
       setErrorCode(FLASH_ERR_ILLEGAL_PARAMS);
    }
-   // Program words
-   while (numWords-- > 0) {
-      if (address == (NV_FSEC_ADDRESS&~3)) {
-         // Check for permanent secure value
-         if ((*data & (FTFL_FSEC_MEEN_MASK)) == (FTFL_FSEC_MEEN_DISABLE)) {
-            setErrorCode(FLASH_ERR_ILLEGAL_SECURITY);
+   if ((controller->fcnfg & FTFL_FCNFG_RAMRDY) != 0) {
+      // Program sections
+      while (numWords > 0) {
+         uint32_t *flexRam      = FLEXRAM_ADDRESS;
+         uint32_t  sectionWords = (flashData->sectorSize-(address&(flashData->sectorSize-1)))/4;
+         uint32_t  count;
+         uint32_t  erased       = 0xFFFFFFFFUL;
+         if (sectionWords > SECTION_SIZE/4) {
+            sectionWords = SECTION_SIZE/4;
          }
+         if (sectionWords > numWords) {
+            sectionWords = numWords;
+         }
+         // Stage section in FlexRAM
+         for (count=0; count<sectionWords; count++) {
+            if ((address+4*count) == (NV_FSEC_ADDRESS&~3)) {
+               // Check for permanent secure value
+               if ((*data & (FTFL_FSEC_MEEN_MASK)) == (FTFL_FSEC_MEEN_DISABLE)) {
+                  setErrorCode(FLASH_ERR_ILLEGAL_SECURITY);
+               }
+            }
+            erased    &= *data;
+            *flexRam++ = *data++;
+         }
+         if (erased == 0xFFFFFFFFUL) {
+            // Already erased value - skip command
+            skipped++;
+         }
+         else {
+            controller->fccob0_3 = (F_PGMSEC << 24) | address;
+            controller->fccob4_7 = (sectionWords << 16);
+            rc = executeCommand(controller);
+            if (rc != FLASH_ERR_OK) {
+               setErrorCode(rc);
+            }
+         }
+         address  += 4*sectionWords;
+         numWords -= sectionWords;
       }
-      controller->fccob0_3 = (F_PGM4 << 24) | address;
-      controller->fccob4_7 = *data;
-      rc = executeCommand(controller);
-      if (rc != FLASH_ERR_OK) {
-         setErrorCode(rc);
+   }
+   else {
+      // Program words
+      while (numWords-- > 0) {
+         if (address == (NV_FSEC_ADDRESS&~3)) {
+            // Check for permanent secure value
+            if ((*data & (FTFL_FSEC_MEEN_MASK)) == (FTFL_FSEC_MEEN_DISABLE)) {
+               setErrorCode(FLASH_ERR_ILLEGAL_SECURITY);
+            }
+         }
+         if (*data == 0xFFFFFFFFUL) {
+            // Already erased value - skip command
+            skipped++;
+         }
+         else {
+            controller->fccob0_3 = (F_PGM4 << 24) | address;
+            controller->fccob4_7 = *data;
+            rc = executeCommand(controller);
+            if (rc != FLASH_ERR_OK) {
+               setErrorCode(rc);
+            }
+         }
+         address += 4;
+         data++;
       }
-      address += 4;
-      data++;
+   }
+   if ((flashData->flags&DO_RECORD_COUNTERS) != 0) {
+      flashData->counters.programSkipped += skipped;
    }
    flashData->flags &= ~DO_PROGRAM_RANGE;
 }
 
+//! Program a range of flash with a repeated pattern (DO_FILL_RANGE)
+//!
+//! The pattern is expanded into a small buffer which is programmed repeatedly
+//! using programRange() so no data is transferred from the host.
+//! fillPattern[0] is programmed at the start of the range.
+//!
+void fillRange(FlashData_t *flashData) {
+   uint32_t         buffer[FILL_CHUNK_SIZE/4];
+   uint32_t         startAddress = flashData->address;
+   uint32_t         size         = flashData->size;
+   const uint32_t  *data         = flashData->data;
+   int              index;
+
+   if ((flashData->flags&DO_FILL_RANGE) == 0) {
+      return;
+   }
+   if ((size&0x03) != 0) {
+      // Only whole longwords are programmed
+      setErrorCode(FLASH_ERR_ILLEGAL_PARAMS);
+   }
+   for (index=0; index<FILL_CHUNK_SIZE/4; index++) {
+      buffer[index] = flashData->fillPattern[index&1];
+   }
+   flashData->data = buffer;
+   while (flashData->address < startAddress+size) {
+      flashData->size = startAddress+size-flashData->address;
+      if (flashData->size > FILL_CHUNK_SIZE) {
+         flashData->size = FILL_CHUNK_SIZE;
+      }
+      flashData->flags |= DO_PROGRAM_RANGE;
+      programRange(flashData);
+      flashData->address += FILL_CHUNK_SIZE;
+   }
+   flashData->address  = startAddress;
+   flashData->size     = size;
+   flashData->data     = data;
+   flashData->flags   &= ~DO_FILL_RANGE;
+}
+
 //! Verify a range of flash against buffer
 //!
 void verifyRange(FlashData_t *flashData) {
@@ -343,11 +556,14 @@ void verifyRange(FlashData_t *flashData) {
 
 //! Erase a range of flash
 //!
+//! Entire flash blocks lying within the range are erased with a single F_ERSBLK
+//!
 void eraseRange(FlashData_t *flashData) {
    FlashController *controller = flashData->controller;
    uint32_t address     = flashData->address;
    uint32_t endAddress  = address + flashData->size - 1; // Inclusive
    uint32_t pageMask    = flashData->sectorSize-1U;
+   uint32_t blockSize;
    int      rc;
    
    if ((flashData->flags&DO_ERASE_RANGE) == 0) {
@@ -362,9 +578,22 @@ void eraseRange(FlashData_t *flashData) {
    // Round end address to end of block (inclusive)
       endAddress |= pageMask;
    
+   if ((address & FLASH_BLOCK_ADDRESS_A23) != 0) {
+      blockSize = DFLASH_BLOCK_SIZE;
+   }
+   else {
+      blockSize = PFLASH_BLOCK_SIZE;
+   }
    // Erase each block/page
    while (address <= endAddress) {
-      controller->fccob0_3 = (F_ERSSCR << 24) | address;
+      uint32_t eraseSize = flashData->sectorSize;
+      uint8_t  command   = F_ERSSCR;
+      if (((address & (blockSize-1)) == 0) && ((endAddress-address) >= (blockSize-1))) {
+         // Range covers entire flash block
+         eraseSize = blockSize;
+         command   = F_ERSBLK;
+      }
+      controller->fccob0_3 = (command << 24) | address;
       rc = executeCommand(controller);
       if (rc != FLASH_ERR_OK) {
          if (rc == FLASH_ERR_PROG_MGSTAT0) {
@@ -373,7 +602,7 @@ void eraseRange(FlashData_t *flashData) {
          setErrorCode(rc);         
       }
       // Advance to start of next block
-      address += flashData->sectorSize;
+      address += eraseSize;
    }
    flashData->flags &= ~DO_ERASE_RANGE;
 }
@@ -466,12 +695,18 @@ void entry(void) {
    // A23 is used for Flash block number
    flashData->address &= 0x008FFFFFUL;
    
+   initCounters(flashData);
    initFlash(flashData);
+   startPhase(flashData, &flashData->counters.eraseTicks);
    eraseFlashBlock(flashData);
    programPartition(flashData) ;
    eraseRange(flashData);
+   startPhase(flashData, &flashData->counters.blankCheckTicks);
    blankCheckRange(flashData);
+   startPhase(flashData, &flashData->counters.programTicks);
    programRange(flashData);
+   fillRange(flashData);
+   startPhase(flashData, &flashData->counters.verifyTicks);
    verifyRange(flashData);
    
    // Indicate completed
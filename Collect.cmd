@@ -27,6 +27,12 @@ set FILE_LIST_ARM=%FILE_LIST_ARM% STM32F100xx-default-flash-program
 echo %FILE_LIST_ARM%
 for %%f in (%FILE_LIST_ARM%) do if exist %~dp0\%%f\RAM copy %~dp0\%%f\RAM\*.hex %DEST_DIR_ARM% 
 
+rem Kinetis FTFx - one build configuration per family (FTFX_FAMILY)
+set FILE_LIST_ARM=FtfaMk FtfaMkl FtfaMkm FtfaMkv10 FtfeMk FtfeMke FtfeMke18 FtflMk FtfxAuto
+
+echo %FILE_LIST_ARM%
+for %%f in (%FILE_LIST_ARM%) do if exist %~dp0\Kinetis-FTFx-flash-program-gcc\%%f copy %~dp0\Kinetis-FTFx-flash-program-gcc\%%f\*.hex %DEST_DIR_ARM% 
+
 set FILE_LIST_ARM=LPC-CM0-flash-program-gcc LPC-CM3-flash-program-gcc
 
 echo %FILE_LIST_ARM%
@@ -100,6 +106,11 @@ set FILE_LIST_S12Z=%FILE_LIST_S12Z% S12Z-FTMRZ-flash-program
 echo %FILE_LIST_S12Z%
 for %%f in (%FILE_LIST_S12Z%) do if exist %~dp0\%%f\RAM copy %~dp0\%%f\RAM\*.sx  %DEST_DIR_S12Z% 
 
+rem
+rem Bundle of all routines (see Host\RoutineBundle.h)
+rem
+if exist %~dp0\Host\BundleTool.exe %~dp0\Host\BundleTool.exe %DEST_DIR% %DEST_DIR%\FlashRoutines.bundle
+
 pause
 exit
 
@@ -122,7 +122,9 @@ typedef struct {
 #define DO_VERIFY_RANGE       (1<<5) // Verify range
 #define DO_PARTITION_FLEXNVM  (1<<7) // Program FlexNVM DFLASH/EEPROM partitioning
 #define DO_TIMING_LOOP        (1<<8) // Counting loop to determine clock speed
-// 9 - 14 reserved
+#define DO_FILL_RANGE         (1<<11) // Program range with FlashData_t.fillPattern (no data transferred)
+// 9 - 13 reserved
+#define DO_RECORD_COUNTERS    (1<<14) // Record performance counters in FlashData_t
 #define IS_COMPLETE           (1<<15)
 
 // Capability masks
@@ -133,7 +135,10 @@ typedef struct {
 #define CAP_VERIFY_RANGE       (1<<5)
 #define CAP_PARTITION_FLEXNVM  (1<<7)
 #define CAP_TIMING             (1<<8)
+#define CAP_FILL_RANGE         (1<<9)
+#define CAP_RECORD_COUNTERS    (1<<14)
 
+#define CAP_HEADER_V2          (1<<10) // Indicates FlashProgramHeader_t.info is valid
 #define CAP_DSC_OVERLAY        (1<<11) // Indicates DSC code in pMEM overlays xRAM
 #define CAP_DATA_FIXED         (1<<12) // Indicates TargetFlashDataHeader is at fixed address
 #define CAP_RELOCATABLE        (1<<15)
@@ -156,8 +161,20 @@ typedef enum {
      FLASH_ERR_UNKNOWN           = (13)  // Unspecified error
 } FlashDriverError_t;
 
+// Size (words) of buffer programmed repeatedly by fillRange() (DO_FILL_RANGE)
+#define FILL_CHUNK_SIZE (16)
+
 typedef void (*EntryPoint_t)(void);
 
+// Performance counters (only written if DO_RECORD_COUNTERS)
+typedef struct {
+   uint32_t         eraseTicks;        // Status polls while erasing
+   uint32_t         blankCheckTicks;   // Status polls while blank checking
+   uint32_t         programTicks;      // Status polls while programming
+   uint32_t         verifyTicks;       // Status polls while verifying
+   uint32_t         programSkipped;    // Program commands skipped as data was all erased value
+} FlashCounters_t;
+
 // Describes a block to be programmed & result
 typedef struct {
    uint16_t         flags;             // Controls actions of routine
@@ -169,6 +186,8 @@ typedef struct {
    uint16_t         dataSize;          // Size of memory range being accessed
    uint16_t         pad;
    const uint16_t  *dataAddress;       // Ptr to data to program
+   FlashCounters_t  counters;          // Performance counters (only if DO_RECORD_COUNTERS)
+   uint32_t         fillPattern[2];    // Pattern repeated over range (only if DO_FILL_RANGE)
 } FlashData_t;
 
 // Timing information
@@ -179,6 +198,39 @@ typedef struct {
    uint32_t         timingCount;       // Timing count
 } TimingData_t;
 
+//==========================================================================================================
+// Information records (CAP_HEADER_V2)
+//
+// FlashProgramHeader_t.info points to a list of tag/length/value records terminated by INFO_END.
+// Values are in target byte order.  Records with unknown tags should be skipped using length.
+//
+#define HEADER_VERSION       (2)
+
+#define INFO_END             (0) // End of list
+#define INFO_VERSION         (1) // Header version (HEADER_VERSION)
+#define INFO_PHRASE_SIZE     (2) // Minimum program unit (bytes)
+#define INFO_SECTOR_SIZE     (3) // Minimum erase unit (bytes)
+#define INFO_BUFFER_ADDRESS  (4) // First free location after image (suitable for data buffer)
+#define INFO_BUFFER_SIZE     (5) // Largest dataSize accepted by a single call (bytes)
+#define INFO_OPERATIONS      (6) // Supported operations (CAP_xxx mask)
+#define INFO_CLOCK           (7) // Clock requirement (INFO_CLOCK_xxx or assumed bus clock in kHz)
+#define INFO_ENDIAN          (8) // Byte order (INFO_ENDIAN_xxx)
+#define INFO_ADDRESS_UNIT    (9) // Size of addressable unit (bytes)
+
+#define INFO_CLOCK_NONE      (0)            // Flash controller needs no clock set-up
+#define INFO_CLOCK_FREQUENCY (0xFFFFFFFFUL) // Flash clock divider is calculated from flashData->frequency
+#define INFO_CLOCK_HOST      (0xFFFFFFFEUL) // Flash clock divider must be set by host
+
+#define INFO_ENDIAN_LITTLE   (0)
+#define INFO_ENDIAN_BIG      (1)
+
+//! Information record
+typedef struct {
+   uint16_t         tag;               // Type of record (INFO_xxx)
+   uint16_t         length;            // Size of value (bytes)
+   uint32_t         value;             // Value
+} FlashInfoRecord_t;
+
 //! Describe the flash programming code
 typedef struct {
    void           (*loadAddress)();    // 0  Address where to load this image
@@ -187,6 +239,7 @@ typedef struct {
    uint16_t         calibFrequency;    // 5  Frequency used for calibFactor
    uint32_t         calibFactor;       // 6  Calibration factor for speed determination
    FlashData_t     *flashData;         // 8  Ptr to information about operation
+   const FlashInfoRecord_t *info;      // 10 Ptr to information records (CAP_HEADER_V2)
 } FlashProgramHeader_t;
 
 #define FLASH_DATA_OFFSET 8
@@ -197,7 +250,22 @@ extern FlashData_t flashData;
 extern void loadAddress();
 
 #define CAPABILITIES (CAP_BLANK_CHECK_RANGE|CAP_ERASE_RANGE|CAP_ERASE_BLOCK|\
-                      CAP_PROGRAM_RANGE|ISOVERLAYED|CAP_VERIFY_RANGE)
+                      CAP_PROGRAM_RANGE|ISOVERLAYED|CAP_VERIFY_RANGE|\
+                      CAP_RECORD_COUNTERS|\
+                      CAP_HEADER_V2|CAP_FILL_RANGE)
+
+//! Information records describing this routine
+//!
+const FlashInfoRecord_t flashInfo[] = {
+     {INFO_VERSION,        4, HEADER_VERSION},
+     {INFO_PHRASE_SIZE,    4, 4},
+     {INFO_BUFFER_SIZE,    4, 0x1FFFEUL},
+     {INFO_OPERATIONS,     4, CAPABILITIES},
+     {INFO_CLOCK,          4, INFO_CLOCK_NONE},
+     {INFO_ENDIAN,         4, INFO_ENDIAN_LITTLE},
+     {INFO_ADDRESS_UNIT,   4, 2},
+     {INFO_END,            0, 0},
+};
 
 //! Flash programming command table
 //!
@@ -208,12 +276,16 @@ const FlashProgramHeader_t flashProgramHeader = {
      /* calibFrequency */ FREQ_CALIB,
      /* clockFactor    */ CLOCK_CALIB,
      /* flashData      */ &flashData,
+     /* info           */ flashInfo,
 };
 
 void  setErrorCode(uint16_t errorCode);
+void  initCounters(void);
+void  startPhase(uint32_t *counter);
 void  initFlash(void);
 void  eraseFlashBlock(void);
 void  programRange(void);
+void  fillRange(void);
 void  verifyRange(void);
 void  eraseRange(void);
 void  blankCheckRange(void);
@@ -276,6 +348,40 @@ pMem:
    rts
 }
 
+//==========================================================================================================
+// Performance counters (DO_RECORD_COUNTERS)
+//
+//  There is no free-running timer available so each phase is timed in flash status
+//  polling iterations, similar to the timing loop count.  Phases that do not wait on
+//  the flash controller (blank check, verify) will record 0.
+//
+static uint32_t *phaseCounter;   // Counter for phase in progress
+static uint32_t  discardTicks;   // Used when not recording
+
+//! Clear counters and select which counter polls are accumulated into
+//!
+void initCounters(void) {
+   FlashData_t *flashData = getHeader();
+   phaseCounter = &discardTicks;
+   if ((flashData->flags&DO_RECORD_COUNTERS) == 0) {
+      return;
+   }
+   flashData->counters.eraseTicks      = 0;
+   flashData->counters.blankCheckTicks = 0;
+   flashData->counters.programTicks    = 0;
+   flashData->counters.verifyTicks     = 0;
+   flashData->counters.programSkipped  = 0;
+}
+
+//! Start accumulating polls into a new counter
+//!
+void startPhase(uint32_t *counter) {
+   FlashData_t *flashData = getHeader();
+   if ((flashData->flags&DO_RECORD_COUNTERS) != 0) {
+      phaseCounter = counter;
+   }
+}
+
 //! Set error code & halt
 //!
 void setErrorCode(uint16_t errorCode) {
@@ -317,6 +423,7 @@ void executeCommand(volatile FlashController *controller) {
 
    // Wait for command complete
    while ((controller->fstat & FTFA_FSTAT_CCIF) == 0) {
+      (*phaseCounter)++;
    }
    // Handle any errors
    if ((controller->fstat & FTFA_FSTAT_FPVIOL ) != 0) {
@@ -377,6 +484,7 @@ void programRange(void) {
    uint32_t         address;
    const uint32_t  *dataAddress;
    uint16_t         numLongwords;
+   uint32_t         skipped = 0;
    
    FlashData_t     *flashData  = getHeader();
    if ((flashData->flags&DO_PROGRAM_RANGE) == 0) {
@@ -397,14 +505,67 @@ void programRange(void) {
             setErrorCode(FLASH_ERR_ILLEGAL_SECURITY);
          }
       }
-      flashData->controller->fccob3_0 = (F_PGM4 << 24) | address;
-      flashData->controller->fccob7_4 = *dataAddress++;
-      executeCommand(flashData->controller);
+      if (*dataAddress == 0xFFFFFFFFUL) {
+         // Already erased value - skip command
+         skipped++;
+      }
+      else {
+         flashData->controller->fccob3_0 = (F_PGM4 << 24) | address;
+         flashData->controller->fccob7_4 = *dataAddress;
+         executeCommand(flashData->controller);
+      }
+      dataAddress++;
       address += 4;
    }
+   if ((flashData->flags&DO_RECORD_COUNTERS) != 0) {
+      flashData->counters.programSkipped += skipped;
+   }
    flashData->flags &= ~DO_PROGRAM_RANGE;
 }
 
+//! Program a range of flash with a repeated pattern (DO_FILL_RANGE)
+//!
+//! The pattern is expanded into a small buffer which is programmed repeatedly
+//! using programRange() so no data is transferred from the host.
+//! fillPattern[0] is programmed at the start of the range.
+//!
+void fillRange(void) {
+   uint32_t         buffer[FILL_CHUNK_SIZE/2];
+   uint32_t         startAddress;
+   uint16_t         size;
+   const uint16_t  *data;
+   int              index;
+
+   FlashData_t *flashData = getHeader();
+   if ((flashData->flags&DO_FILL_RANGE) == 0) {
+      return;
+   }
+   startAddress = flashData->address;
+   size         = flashData->dataSize;
+   data         = flashData->dataAddress;
+   if ((size&0x01) != 0) {
+      // Only whole longwords (2 words) are programmed
+      setErrorCode(FLASH_ERR_ILLEGAL_PARAMS);
+   }
+   for (index=0; index<FILL_CHUNK_SIZE/2; index++) {
+      buffer[index] = flashData->fillPattern[index&1];
+   }
+   flashData->dataAddress = (const uint16_t *)buffer;
+   while (flashData->address < startAddress+size) {
+      flashData->dataSize = (uint16_t)(startAddress+size-flashData->address);
+      if (flashData->dataSize > FILL_CHUNK_SIZE) {
+         flashData->dataSize = FILL_CHUNK_SIZE;
+      }
+      flashData->flags |= DO_PROGRAM_RANGE;
+      programRange();
+      flashData->address += FILL_CHUNK_SIZE;
+   }
+   flashData->address      = startAddress;
+   flashData->dataSize     = size;
+   flashData->dataAddress  = data;
+   flashData->flags       &= ~DO_FILL_RANGE;
+}
+
 //! Verify a range of flash against buffer
 //!
 void verifyRange(void) {
@@ -535,12 +696,18 @@ void entry(void) {
    OCCS_OSCTL1   = (OCCS_OSCTL1&~0x3FFFF)|(SIM_NVMOPT2H&0x3FFF);
 #endif
    
+   initCounters();
    initFlash();
    doTiming();
+   startPhase(&flashData->counters.eraseTicks);
    eraseFlashBlock();
    eraseRange();
+   startPhase(&flashData->counters.blankCheckTicks);
    blankCheckRange();
+   startPhase(&flashData->counters.programTicks);
    programRange();
+   fillRange();
+   startPhase(&flashData->counters.verifyTicks);
    verifyRange();
 
    setErrorCode(FLASH_ERR_OK);
@@ -19,6 +19,7 @@
 //!
 //! History
 //! =======================================================================================================
+//! 19 Oct 26 | Added EEPROM update mode (DO_UPDATE_EEPROM)                                     V4.10.6.150
 //! 26 Apr 22 | Changed WDOG to use refresh rather than disable                                 V4.10.6.140
 //!  4 Mar 14 | Removed unnecessary alignment check on EEPROM                                   V4.10.6.120
 //! =======================================================================================================
@@ -117,6 +118,8 @@ typedef struct {
 #define DO_VERIFY_RANGE       (1<<5) // Verify range
 #define DO_PARTITION_FLEXNVM  (1<<7) // Program FlexNVM DFLASH/EEPROM partitioning
 #define DO_TIMING_LOOP        (1<<8) // Counting loop to determine clock speed
+#define DO_FILL_RANGE         (1<<11) // Program range with FlashData_t.fillPattern (no data transferred)
+#define DO_UPDATE_EEPROM      (1<<13) // Program EEPROM range erasing sectors only when necessary
 
 #define IS_COMPLETE            (1<<15)
                              
@@ -128,7 +131,10 @@ typedef struct {
 #define CAP_VERIFY_RANGE       (1<<5)
 #define CAP_PARTITION_FLEXNVM  (1<<7)
 #define CAP_TIMING             (1<<8)
+#define CAP_FILL_RANGE         (1<<9)
+#define CAP_UPDATE_EEPROM      (1<<13)
 
+#define CAP_HEADER_V2          (1<<10) // Indicates FlashProgramHeader_t.info is valid
 #define CAP_DSC_OVERLAY        (1<<11) // Indicates DSC code in pMEM overlays xRAM
 #define CAP_DATA_FIXED         (1<<12) // Indicates TargetFlashDataHeader is at fixed address
                                
@@ -171,12 +177,47 @@ typedef struct {
    uint32_t           address;      // 12: Linear memory address being accessed
    uint16_t           size;         // 16: Size of memory range being accessed
    const uint16_t    *data;         // 18: Ptr to data to program
+   uint16_t           skipped;      // 20: Program commands skipped as data was all erased value
+   uint16_t           fillPattern[4]; // 22: Pattern repeated over range (only if DO_FILL_RANGE)
 } FlashData_t;                      
 
 #define ERROR_CODE_OFFSET   0
 #define FLAGS_OFFSET        2
 #define CONTROLLER_OFFSET   4
  
+//==========================================================================================================
+// Information records (CAP_HEADER_V2)
+//
+// FlashProgramHeader_t.info points to a list of tag/length/value records terminated by INFO_END.
+// Values are in target byte order.  Records with unknown tags should be skipped using length.
+//
+#define HEADER_VERSION       (2)
+
+#define INFO_END             (0) // End of list
+#define INFO_VERSION         (1) // Header version (HEADER_VERSION)
+#define INFO_PHRASE_SIZE     (2) // Minimum program unit (bytes)
+#define INFO_SECTOR_SIZE     (3) // Minimum erase unit (bytes)
+#define INFO_BUFFER_ADDRESS  (4) // First free location after image (suitable for data buffer)
+#define INFO_BUFFER_SIZE     (5) // Largest dataSize accepted by a single call (bytes)
+#define INFO_OPERATIONS      (6) // Supported operations (CAP_xxx mask)
+#define INFO_CLOCK           (7) // Clock requirement (INFO_CLOCK_xxx or assumed bus clock in kHz)
+#define INFO_ENDIAN          (8) // Byte order (INFO_ENDIAN_xxx)
+#define INFO_ADDRESS_UNIT    (9) // Size of addressable unit (bytes)
+
+#define INFO_CLOCK_NONE      (0)            // Flash controller needs no clock set-up
+#define INFO_CLOCK_FREQUENCY (0xFFFFFFFFUL) // Flash clock divider is calculated from flashData->frequency
+#define INFO_CLOCK_HOST      (0xFFFFFFFEUL) // Flash clock divider must be set by host
+
+#define INFO_ENDIAN_LITTLE   (0)
+#define INFO_ENDIAN_BIG      (1)
+
+//! Information record
+typedef struct {
+   uint16_t         tag;               // Type of record (INFO_xxx)
+   uint16_t         length;            // Size of value (bytes)
+   uint32_t         value;             // Value
+} FlashInfoRecord_t;
+
 //! Describe the flash programming code
 //!
 typedef struct {
@@ -185,14 +226,21 @@ typedef struct {
    uint16_t         capabilities;   //  4: Capabilities of routine
    uint32_t         calibFactor;    //  8: Calibration factor for speed determination
    FlashData_t     *flashData;      // 12: Ptr to information about operation
+   const FlashInfoRecord_t *info;   // 14: Ptr to information records (CAP_HEADER_V2)
 } FlashProgramHeader_t;
 
 //! Some stack space
-#define STACK_SIZE 27
+#define STACK_SIZE 36
 volatile uint8_t stackSpace[STACK_SIZE];
 
 // Describes a block to be programmed & result
 FlashData_t gFlashData;
+
+//! Largest EEPROM sector handled by DO_UPDATE_EEPROM
+#define MAX_EEPROM_SECTOR_SIZE (4)
+
+//! Image of EEPROM sector being updated
+uint8_t eepromSector[MAX_EEPROM_SECTOR_SIZE];
                               
 void asm_entry(void);
 const FlashProgramHeader_t gFlashProgramHeader;
@@ -200,16 +248,32 @@ const FlashProgramHeader_t gFlashProgramHeader;
 // Used by programmer to locate flashProgramHeader 
 const FlashProgramHeader_t *const headerPtr = &gFlashProgramHeader;
 
+#define CAPABILITIES (CAP_BLANK_CHECK_RANGE|CAP_ERASE_RANGE|CAP_ERASE_BLOCK|CAP_PROGRAM_RANGE|\
+                      CAP_VERIFY_RANGE|CAP_UPDATE_EEPROM|CAP_DATA_FIXED|CAP_HEADER_V2|\
+                      CAP_FILL_RANGE)
+
+//! Information records describing this routine
+//!
+const FlashInfoRecord_t flashInfo[] = {
+     {INFO_VERSION,        4, HEADER_VERSION},
+     {INFO_PHRASE_SIZE,    4, 4},
+     {INFO_BUFFER_SIZE,    4, 0xFFFFUL},
+     {INFO_OPERATIONS,     4, CAPABILITIES},
+     {INFO_CLOCK,          4, 16000},
+     {INFO_ENDIAN,         4, INFO_ENDIAN_BIG},
+     {INFO_ADDRESS_UNIT,   4, 1},
+     {INFO_END,            0, 0},
+};
+
 //! Flash programming information table
 //!
 const FlashProgramHeader_t gFlashProgramHeader = {
      /* loadAddress   */  (uint16_t)&headerPtr,  // load address of image
      /* entry         */  asm_entry,             // entry point for code
-     /* capabilities  */  CAP_BLANK_CHECK_RANGE|CAP_ERASE_RANGE|CAP_ERASE_BLOCK|
-                          CAP_PROGRAM_RANGE|CAP_VERIFY_RANGE|
-                          CAP_DATA_FIXED,
+     /* capabilities  */  CAPABILITIES,
      /* clockFactor   */  0,
      /* flashData     */  &gFlashData,
+     /* info          */  flashInfo,
 };
 
 #pragma CODE_SEG code
@@ -217,6 +281,9 @@ void  setErrorCode(uint8_t errorCode);
 void  initFlash(void);
 void  massEraseFlash(void);
 void  programRange(void);
+void  fillRange(void);
+void  programEeprom(uint16_t addressH, uint16_t addressL, const uint8_t *data, uint8_t numBytes);
+void  updateEepromRange(void);
 void  verifyRange(void);
 void  eraseRange(void);
 void  blankCheckRange(void);
@@ -381,6 +448,110 @@ void massEraseFlash(void) {
    gFlashData.flags &= ~DO_ERASE_BLOCK;
 }
 
+//! Program 1 to 4 EEPROM bytes
+//!
+//! @param addressH - Upper address bits incl. EEPROM modifier
+//! @param addressL - Lower 16-bits of address
+//! @param data     - Bytes to program
+//! @param numBytes - Number of bytes to program (1-4)
+//!
+void programEeprom(uint16_t addressH, uint16_t addressL, const uint8_t *data, uint8_t numBytes) {
+   FlashController *controller = gFlashData.controller;
+   uint8_t          index;
+   
+   // Write command
+   controller->fccobix = 0; controller->fccob.b[0] = FCMD_PROGRAM_EEPROM; 
+                            controller->fccob.b[1] = (uint8_t)addressH;
+   controller->fccobix = 1; controller->fccob.w    = addressL;
+   // Bytes in fccob[2..5].low
+   for (index=2; index<(2+numBytes); index++) {
+      controller->fccobix = index; controller->fccob.b[1] = *data++;
+   }
+   doFlashCommand();
+}
+
+//! Update a range of EEPROM from buffer
+//!
+//! Each EEPROM sector touched by the range is compared with the new contents:
+//!   - Unchanged sectors are skipped
+//!   - Sectors only requiring 1->0 bit changes have just the changed bytes programmed
+//!   - Otherwise the sector is erased and re-programmed
+//!
+//! Bytes of a partial sector lying outside the range are preserved.
+//! Eliminates the need for a separate DO_ERASE_RANGE pass.
+//!
+void updateEepromRange(void) {
+   uint16_t         addressH;
+   uint16_t         addressL;
+   uint16_t         sectorAddress;
+   uint16_t         numBytes;
+   const uint8_t   *data;
+   const uint8_t   *eeprom;
+   uint8_t          sectorSize;
+   uint8_t          index;
+   uint8_t          eraseNeeded;
+
+   addressH   = (uint16_t)(gFlashData.address>>16);
+   addressL   = (uint16_t)gFlashData.address;
+   data       = (const uint8_t *)gFlashData.data;
+   numBytes   = gFlashData.size;
+   
+   // Sector must be a small power of 2 (check before narrowing)
+   if ((gFlashData.sectorSize == 0) || (gFlashData.sectorSize > MAX_EEPROM_SECTOR_SIZE) || 
+       ((gFlashData.sectorSize & (gFlashData.sectorSize-1)) != 0)) {
+      setErrorCode(FLASH_ERR_ILLEGAL_PARAMS);
+   }
+   sectorSize = (uint8_t)gFlashData.sectorSize;
+   while (numBytes > 0) {
+      refreshWatchdog();
+      sectorAddress = addressL & ~(uint16_t)(sectorSize-1);
+      eeprom        = (const uint8_t *)sectorAddress;
+      eraseNeeded   = 0;
+      
+      // Merge new data with current sector contents
+      for (index=0; index<sectorSize; index++) {
+         uint8_t current = eeprom[index];
+         uint8_t value   = current;
+         if ((numBytes > 0) && ((sectorAddress+index) == addressL)) {
+            value = *data++;
+            addressL++;
+            numBytes--;
+         }
+         eepromSector[index] = value;
+         if (value != current) {
+            if ((value & (uint8_t)~current) != 0) {
+               // A bit has to change 0->1
+               eraseNeeded = 1;
+            }
+         }
+      }
+      if (eraseNeeded) {
+         // Erase sector & re-program entire sector
+         gFlashData.controller->fccobix = 0; gFlashData.controller->fccob.b[0] = FCMD_ERASE_EEPROM_SECTOR; 
+                                             gFlashData.controller->fccob.b[1] = (uint8_t)addressH;
+         gFlashData.controller->fccobix = 1; gFlashData.controller->fccob.w    = sectorAddress;
+         doFlashCommand();
+         programEeprom(addressH, sectorAddress, eepromSector, sectorSize);
+      }
+      else {
+         // Only program the runs of bytes that change - unchanged bytes are not re-programmed
+         index = 0;
+         while (index < sectorSize) {
+            uint8_t start;
+            if (eepromSector[index] == eeprom[index]) {
+               index++;
+               continue;
+            }
+            start = index;
+            do {
+               index++;
+            } while ((index < sectorSize) && (eepromSector[index] != eeprom[index]));
+            programEeprom(addressH, sectorAddress+start, eepromSector+start, (uint8_t)(index-start));
+         }
+      }
+   }
+}
+
 //! Program a range of flash/EEprom from buffer
 //!
 void programRange(void) {
@@ -411,6 +582,20 @@ void programRange(void) {
       }
       // Program 1 to 2 Flash phrases (2 words)
       while (numPhrases-- > 0) {
+         uint16_t erased = data[0]&data[1];
+         if (numPhrases > 0) {
+            erased &= data[2]&data[3];
+         }
+         if (erased == 0xFFFF) {
+            // Already erased value - skip command
+            gFlashData.skipped++;
+            if (numPhrases > 0) {
+               numPhrases--;
+            }
+            data     += 4;
+            addressL += 8;
+            continue;
+         }
          // Write command
          controller->fccobix = 0; controller->fccob.b[0] = FCMD_PROGRAM_FLASH; 
                                   controller->fccob.b[1] = (uint8_t)addressH;
@@ -428,6 +613,9 @@ void programRange(void) {
          addressL += 8;
       }
    }
+   else if ((gFlashData.flags&DO_UPDATE_EEPROM) != 0) {
+      updateEepromRange();
+   }
    else {
       uint16_t numBytes = gFlashData.size;
       // Program 1 to 4 EEPROM bytes
@@ -457,7 +645,46 @@ void programRange(void) {
          addressL += 4;
       }
    }
-   gFlashData.flags &= ~DO_PROGRAM_RANGE;
+   gFlashData.flags &= ~(DO_PROGRAM_RANGE|DO_UPDATE_EEPROM);
+}
+
+//! Program a range of flash with a repeated pattern (DO_FILL_RANGE)
+//!
+//! fillPattern[] is programmed repeatedly using programRange() so no data
+//! is transferred from the host.  fillPattern[0] is programmed at the start of the range.
+//! DO_UPDATE_EEPROM applies to every chunk (programRange() clears it after each call).
+//!
+void fillRange(void) {
+   uint32_t         startAddress;
+   uint16_t         size;
+   const uint16_t  *data;
+   uint16_t         update;
+
+   if ((gFlashData.flags&DO_FILL_RANGE) == 0) {
+      return;
+   }
+   startAddress    = gFlashData.address;
+   size            = gFlashData.size;
+   data            = gFlashData.data;
+   update          = gFlashData.flags&DO_UPDATE_EEPROM;
+   if (((startAddress&ADDRESS_EEPROM) == 0) && ((size&0x3) != 0)) {
+      // Flash requires a multiple of longwords (4-byte)
+      setErrorCode(FLASH_ERR_ILLEGAL_PARAMS);
+   }
+   gFlashData.data = gFlashData.fillPattern;
+   while (gFlashData.address < startAddress+size) {
+      gFlashData.size = (uint16_t)(startAddress+size-gFlashData.address);
+      if (gFlashData.size > sizeof(gFlashData.fillPattern)) {
+         gFlashData.size = sizeof(gFlashData.fillPattern);
+      }
+      gFlashData.flags |= DO_PROGRAM_RANGE|update;
+      programRange();
+      gFlashData.address += sizeof(gFlashData.fillPattern);
+   }
+   gFlashData.address  = startAddress;
+   gFlashData.size     = size;
+   gFlashData.data     = data;
+   gFlashData.flags   &= ~(DO_FILL_RANGE|DO_UPDATE_EEPROM);
 }
 
 //! Verify a range of flash against buffer
@@ -564,11 +791,14 @@ void blankCheckRange() {
 //! Main C entry point
 //!
 void entry(void) {
+   gFlashData.skipped = 0;
+
    initFlash();
    massEraseFlash();
    eraseRange();
    blankCheckRange();
    programRange();
+   fillRange();
    verifyRange();
 
    setErrorCode(FLASH_ERR_OK);
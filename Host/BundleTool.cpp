@@ -0,0 +1,76 @@
+/**
+ * Creates a routine bundle from GeneratedFiles
+ *
+ *  Usage: BundleTool <GeneratedFiles directory> <bundle file>
+ *
+ *  Each sub-directory named after a family (ARM, CFV1, CFVx, DSC, HCS08, S12Z)
+ *  is scanned for routine images.
+ */
+#include <stdio.h>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <dirent.h>
+#endif
+
+#include "RoutineBundle.h"
+
+/**
+ * List regular files in directory
+ */
+static std::vector<std::string> listFiles(const std::string &directory) {
+   std::vector<std::string> files;
+#if defined(_WIN32)
+   WIN32_FIND_DATAA findData;
+   HANDLE handle = FindFirstFileA((directory+"\\*").c_str(), &findData);
+   if (handle == INVALID_HANDLE_VALUE) {
+      return files;
+   }
+   do {
+      if ((findData.dwFileAttributes&FILE_ATTRIBUTE_DIRECTORY) == 0) {
+         files.push_back(directory+"\\"+findData.cFileName);
+      }
+   } while (FindNextFileA(handle, &findData));
+   FindClose(handle);
+#else
+   DIR *dir = opendir(directory.c_str());
+   if (dir == nullptr) {
+      return files;
+   }
+   while (struct dirent *entry = readdir(dir)) {
+      if (entry->d_type == DT_REG) {
+         files.push_back(directory+"/"+entry->d_name);
+      }
+   }
+   closedir(dir);
+#endif
+   return files;
+}
+
+int main(int argc, char *argv[]) {
+   static const char *const families[] = {"ARM", "CFV1", "CFVx", "DSC", "HCS08", "S12Z"};
+
+   if (argc != 3) {
+      fprintf(stderr, "Usage: %s <GeneratedFiles directory> <bundle file>\n", argv[0]);
+      return 1;
+   }
+   try {
+      RoutineBundleWriter writer;
+      for (const char *family : families) {
+         for (const std::string &path : listFiles(std::string(argv[1])+"/"+family)) {
+            writer.addFile(family, path);
+            printf("%-6s %s\n", family, path.c_str());
+         }
+      }
+      writer.write(argv[2]);
+   }
+   catch (std::exception &e) {
+      fprintf(stderr, "%s\n", e.what());
+      return 1;
+   }
+   return 0;
+}
@@ -0,0 +1,43 @@
+/**
+ * CRC-32 (IEEE 802.3, reflected polynomial 0xEDB88320)
+ *
+ *  Matches the self-check calculation in the routines (CAP_SELF_CHECK).
+ */
+#ifndef CRC32_H
+#define CRC32_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Calculate CRC-32
+ *
+ * @param data Data to include
+ * @param size Number of bytes
+ * @param crc  Result of previous call when calculating over several blocks
+ *
+ * @return CRC-32
+ */
+inline uint32_t crc32(const uint8_t *data, size_t size, uint32_t crc=0) {
+   struct Table {
+      uint32_t values[256];
+      Table() {
+         for (uint32_t index=0; index<256; index++) {
+            uint32_t value = index;
+            for (int bit=0; bit<8; bit++) {
+               value = (value>>1)^((value&1)?0xEDB88320UL:0);
+            }
+            values[index] = value;
+         }
+      }
+   };
+   static const Table table;
+
+   crc = ~crc;
+   for (size_t index=0; index<size; index++) {
+      crc = table.values[(crc^data[index])&0xFF]^(crc>>8);
+   }
+   return ~crc;
+}
+
+#endif // CRC32_H
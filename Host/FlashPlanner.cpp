@@ -0,0 +1,361 @@
+/**
+ * Flash operation planner
+ *
+ *  See FlashPlanner.h
+ */
+#include <algorithm>
+#include <stdexcept>
+
+#include "FlashPlanner.h"
+
+namespace {
+
+/** Address range [start, end) */
+struct Span {
+   uint64_t start;
+   uint64_t end;
+};
+
+uint64_t alignDown(uint64_t value, uint32_t alignment) {
+   return value - (value % alignment);
+}
+
+uint64_t alignUp(uint64_t value, uint32_t alignment) {
+   return alignDown(value+alignment-1, alignment);
+}
+
+/**
+ * Add span to sorted list merging with last entry if overlapping or adjacent
+ */
+void appendSpan(std::vector<Span> &spans, uint64_t start, uint64_t end) {
+   if (!spans.empty() && (start <= spans.back().end)) {
+      spans.back().end = std::max(spans.back().end, end);
+      return;
+   }
+   spans.push_back(Span{start, end});
+}
+
+/**
+ * Number of bytes of [start, end) covered by spans
+ */
+uint64_t overlap(const std::vector<Span> &spans, uint64_t start, uint64_t end) {
+   uint64_t total = 0;
+   for (const Span &span : spans) {
+      if (span.start >= end) {
+         break;
+      }
+      uint64_t from = std::max(span.start, start);
+      uint64_t to   = std::min(span.end, end);
+      if (from < to) {
+         total += to-from;
+      }
+   }
+   return total;
+}
+
+/**
+ * Check if [start, end) lies within a single span
+ */
+bool within(const std::vector<Span> &spans, uint64_t start, uint64_t end) {
+   for (const Span &span : spans) {
+      if ((span.start <= start) && (end <= span.end)) {
+         return true;
+      }
+   }
+   return false;
+}
+
+uint32_t readValue(const uint8_t *value, uint32_t length, bool bigEndian) {
+   uint32_t result = 0;
+   for (uint32_t index=0; index<length; index++) {
+      unsigned shift = bigEndian?8*(length-1-index):8*index;
+      result |= (uint32_t)value[index]<<shift;
+   }
+   return result;
+}
+
+} // namespace
+
+bool RoutineInfo::applyInfoRecords(const uint8_t *records, uint32_t length, bool targetBigEndian) {
+   uint32_t offset = 0;
+   while ((offset+4) <= length) {
+      uint32_t tag       = readValue(records+offset,   2, targetBigEndian);
+      uint32_t valueSize = readValue(records+offset+2, 2, targetBigEndian);
+      if (tag == INFO_END) {
+         return true;
+      }
+      if ((offset+4+valueSize) > length) {
+         break;
+      }
+      uint32_t value = readValue(records+offset+4, std::min(valueSize, 4U), targetBigEndian);
+      switch(tag) {
+      case INFO_PHRASE_SIZE:    phraseSize    = value;                       break;
+      case INFO_SECTOR_SIZE:    sectorSize    = value;                       break;
+      case INFO_BUFFER_ADDRESS: bufferAddress = value;                       break;
+      case INFO_BUFFER_SIZE:    bufferSize    = value;                       break;
+      case INFO_OPERATIONS:     capabilities |= value;                       break;
+      case INFO_ENDIAN:         bigEndian     = (value == INFO_ENDIAN_BIG);  break;
+      case INFO_ADDRESS_UNIT:   addressUnit   = value;                       break;
+      case INFO_CHECK_START:    checkStart    = value;                       break;
+      case INFO_CHECK_END:      checkEnd      = value;                       break;
+      default:                                                               break;
+      }
+      offset += 4+valueSize;
+   }
+   return false;
+}
+
+FlashPlanner::FlashPlanner(const std::vector<FlashRegion> &regions, const RoutineInfo &routine, const CommandCosts &costs) :
+   regions(regions), routine(routine), costs(costs) {
+   std::sort(this->regions.begin(), this->regions.end(),
+      [](const FlashRegion &a, const FlashRegion &b) { return a.start < b.start; });
+}
+
+uint32_t FlashPlanner::phraseSizeOf(const FlashRegion &region) const {
+   return std::max(std::max(region.phraseSize, routine.phraseSize), 1U);
+}
+
+uint32_t FlashPlanner::sectorSizeOf(const FlashRegion &region) const {
+   uint32_t sectorSize = (region.sectorSize != 0)?region.sectorSize:routine.sectorSize;
+   return std::max(sectorSize, phraseSizeOf(region));
+}
+
+const FlashRegion *FlashPlanner::regionOf(uint32_t address) const {
+   for (const FlashRegion &region : regions) {
+      if ((address >= region.start) && ((uint64_t)address < (uint64_t)region.start+region.size)) {
+         return &region;
+      }
+   }
+   return nullptr;
+}
+
+double FlashPlanner::estimate(const PlannedCall &call) const {
+   double cost = costs.callOverhead;
+
+   const FlashRegion *region = regionOf(call.address);
+   if ((region == nullptr) || (call.size == 0)) {
+      return cost;
+   }
+   uint64_t end = (uint64_t)call.address+call.size;
+   if ((call.flags&DO_ERASE_BLOCK) != 0) {
+      cost += costs.eraseBlock;
+   }
+   if ((call.flags&DO_ERASE_RANGE) != 0) {
+      uint32_t sectorSize = sectorSizeOf(*region);
+      cost += costs.eraseSector*((alignUp(end, sectorSize)-alignDown(call.address, sectorSize))/sectorSize);
+   }
+   if ((call.flags&DO_BLANK_CHECK_RANGE) != 0) {
+      cost += costs.blankCheckByte*call.size;
+   }
+   if ((call.flags&(DO_PROGRAM_RANGE|DO_VERIFY_RANGE)) != 0) {
+      cost += costs.transferByte*call.size;
+   }
+   if ((call.flags&DO_PROGRAM_RANGE) != 0) {
+      uint32_t phraseSize = phraseSizeOf(*region);
+      cost += costs.programPhrase*((call.size+phraseSize-1)/phraseSize);
+   }
+   if ((call.flags&DO_VERIFY_RANGE) != 0) {
+      cost += costs.verifyByte*call.size;
+   }
+   return cost;
+}
+
+PlannedCall &FlashPlanner::addCall(Schedule &schedule, const FlashRegion &region, uint32_t flags, uint32_t address, uint32_t size) const {
+   PlannedCall call;
+   call.flags      = DO_INIT_FLASH|flags;
+   call.address    = address;
+   call.size       = size;
+   call.sectorSize = sectorSizeOf(region);
+   call.cost       = estimate(call);
+
+   if ((flags&DO_ERASE_BLOCK) != 0) {
+      schedule.erasedBytes += region.size;
+   }
+   if ((flags&DO_ERASE_RANGE) != 0) {
+      schedule.erasedBytes += alignUp((uint64_t)address+size, call.sectorSize)-alignDown(address, call.sectorSize);
+   }
+   if ((flags&DO_PROGRAM_RANGE) != 0) {
+      schedule.programmedBytes += size;
+   }
+   schedule.cost += call.cost;
+   schedule.calls.push_back(std::move(call));
+   return schedule.calls.back();
+}
+
+void FlashPlanner::planRegion(const FlashRegion &region, const SparseImage &image, const PlanOptions &options, Schedule &schedule) const {
+   const uint32_t phraseSize = phraseSizeOf(region);
+   const uint32_t sectorSize = sectorSizeOf(region);
+   const uint64_t regionEnd  = (uint64_t)region.start+region.size;
+
+   // Image data within region and the phrase aligned segments containing it
+   std::vector<Span> present;
+   std::vector<Span> segments;
+   for (const SparseImage::ExtentMap::value_type &extent : image) {
+      uint64_t from = std::max((uint64_t)extent.first, (uint64_t)region.start);
+      uint64_t to   = std::min((uint64_t)extent.first+extent.second.size(), regionEnd);
+      if (from >= to) {
+         continue;
+      }
+      appendSpan(present, from, to);
+      appendSpan(segments, alignDown(from, phraseSize), std::min(alignUp(to, phraseSize), regionEnd));
+   }
+   if (segments.empty()) {
+      return;
+   }
+   uint64_t imageBytes = overlap(present, region.start, regionEnd);
+
+   // Choose how region is erased
+   bool blockErase = false;
+   std::vector<Span> eraseSpans;
+   if (options.eraseMode != PlanOptions::EraseNone) {
+      for (const Span &segment : segments) {
+         appendSpan(eraseSpans, alignDown(segment.start, sectorSize), std::min(alignUp(segment.end, sectorSize), regionEnd));
+      }
+      bool canBlockErase = region.blockErasable && ((routine.capabilities&CAP_ERASE_BLOCK) != 0);
+      bool canRangeErase = (routine.capabilities&CAP_ERASE_RANGE) != 0;
+      bool wholeRegion   = (options.eraseMode == PlanOptions::EraseAll);
+      if (options.eraseMode == PlanOptions::EraseFastest) {
+         uint64_t sectors = 0;
+         for (const Span &span : eraseSpans) {
+            sectors += (span.end-span.start)/sectorSize;
+         }
+         double wholeCost = canBlockErase?(costs.callOverhead+costs.eraseBlock):(costs.eraseSector*(region.size/sectorSize));
+         wholeRegion = !canRangeErase || (wholeCost < costs.eraseSector*sectors);
+      }
+      if (wholeRegion) {
+         if (canBlockErase) {
+            blockErase = true;
+            eraseSpans.clear();
+         }
+         else {
+            eraseSpans.assign(1, Span{region.start, regionEnd});
+         }
+      }
+      if (!eraseSpans.empty() && !canRangeErase) {
+         throw std::invalid_argument("Routine does not support erase range");
+      }
+   }
+   if (blockErase) {
+      addCall(schedule, region, DO_ERASE_BLOCK|(options.blankCheck?DO_BLANK_CHECK_RANGE:0), region.start, region.size);
+   }
+
+   // Where erased-value padding may be programmed i.e. locations that are (or will be) erased
+   const std::vector<Span> &mergeZones =
+      blockErase?std::vector<Span>(1, Span{region.start, regionEnd}):
+      (options.eraseMode == PlanOptions::EraseNone)?segments:eraseSpans;
+
+   // Runs of phrases to program
+   const double gapCostPerByte =
+      costs.transferByte + (options.verify?costs.verifyByte:0) + costs.programPhrase/phraseSize;
+   std::vector<Span> runs;
+   std::vector<uint8_t> buffer;
+   for (const Span &segment : segments) {
+      buffer.resize((size_t)(segment.end-segment.start));
+      image.read((uint32_t)segment.start, (uint32_t)(segment.end-segment.start), region.erasedValue, buffer.data());
+      for (uint64_t offset=0; offset<buffer.size(); offset+=phraseSize) {
+         bool erased = options.skipErased &&
+            std::all_of(&buffer[offset], &buffer[offset]+phraseSize, [&](uint8_t value) { return value == region.erasedValue; });
+         if (erased) {
+            continue;
+         }
+         uint64_t start = segment.start+offset;
+         uint64_t end   = start+phraseSize;
+         if (!runs.empty() &&
+             ((start == runs.back().end) ||
+              ((gapCostPerByte*(start-runs.back().end) < costs.callOverhead) && within(mergeZones, runs.back().end, start)))) {
+            runs.back().end = end;
+         }
+         else {
+            runs.push_back(Span{start, end});
+         }
+      }
+   }
+
+   // Program runs in buffer sized chunks erasing sectors ahead of programming
+   uint32_t maxChunk = (uint32_t)alignDown(std::min(routine.bufferSize, 0x80000000U), phraseSize);
+   if (maxChunk == 0) {
+      throw std::invalid_argument("Routine buffer is smaller than a phrase");
+   }
+   if ((routine.capabilities&CAP_PROGRAM_RANGE) == 0) {
+      throw std::invalid_argument("Routine does not support program range");
+   }
+   if (options.verify && ((routine.capabilities&CAP_VERIFY_RANGE) == 0)) {
+      throw std::invalid_argument("Routine does not support verify range");
+   }
+   if (options.blankCheck && ((routine.capabilities&CAP_BLANK_CHECK_RANGE) == 0)) {
+      throw std::invalid_argument("Routine does not support blank check range");
+   }
+   const uint32_t eraseFlags = DO_ERASE_RANGE|(options.blankCheck?DO_BLANK_CHECK_RANGE:0);
+
+   size_t   eraseIndex = 0;
+   uint64_t erasedEnd  = region.start;
+   // Erase (if emit) or mark as erased all pending sectors below limit
+   auto advanceErase = [&](uint64_t limit, bool emit) {
+      while (eraseIndex < eraseSpans.size()) {
+         const Span &span = eraseSpans[eraseIndex];
+         uint64_t from = std::max(span.start, erasedEnd);
+         uint64_t to   = std::min(span.end, limit);
+         if (emit && (from < to)) {
+            addCall(schedule, region, eraseFlags, (uint32_t)from, (uint32_t)(to-from));
+         }
+         if (span.end > limit) {
+            break;
+         }
+         eraseIndex++;
+      }
+      erasedEnd = std::max(erasedEnd, limit);
+   };
+
+   uint64_t programmedImageBytes = 0;
+   for (const Span &run : runs) {
+      for (uint64_t start=run.start; start<run.end; start+=maxChunk) {
+         uint64_t end = std::min(run.end, start+maxChunk);
+         uint32_t flags = DO_PROGRAM_RANGE|(options.verify?DO_VERIFY_RANGE:0);
+
+         uint64_t sectorStart = alignDown(start, sectorSize);
+         uint64_t sectorEnd   = std::min(alignUp(end, sectorSize), regionEnd);
+         advanceErase(sectorStart, true);
+         if (!eraseSpans.empty() && (sectorEnd > erasedEnd)) {
+            if (sectorStart >= erasedEnd) {
+               // Nothing in these sectors has been programmed yet - erase as part of this call
+               flags |= eraseFlags;
+               advanceErase(sectorEnd, false);
+            }
+            else {
+               advanceErase(sectorEnd, true);
+            }
+         }
+         else if ((options.eraseMode == PlanOptions::EraseNone) && options.blankCheck) {
+            flags |= DO_BLANK_CHECK_RANGE;
+         }
+         PlannedCall &call = addCall(schedule, region, flags, (uint32_t)start, (uint32_t)(end-start));
+         call.data.resize((size_t)(end-start));
+         image.read((uint32_t)start, (uint32_t)(end-start), region.erasedValue, call.data.data());
+
+         uint64_t imageInChunk = overlap(present, start, end);
+         programmedImageBytes += imageInChunk;
+         schedule.paddingBytes += (end-start)-imageInChunk;
+      }
+   }
+   advanceErase(regionEnd, true);
+   schedule.skippedBytes += imageBytes-programmedImageBytes;
+}
+
+Schedule FlashPlanner::plan(const SparseImage &image, const PlanOptions &options) const {
+   Schedule schedule;
+
+   uint64_t usedBytes = 0;
+   for (const FlashRegion &region : regions) {
+      uint64_t regionEnd = (uint64_t)region.start+region.size;
+      for (const SparseImage::ExtentMap::value_type &extent : image) {
+         uint64_t from = std::max((uint64_t)extent.first, (uint64_t)region.start);
+         uint64_t to   = std::min((uint64_t)extent.first+extent.second.size(), regionEnd);
+         if (from < to) {
+            usedBytes += to-from;
+         }
+      }
+      planRegion(region, image, options, schedule);
+   }
+   schedule.droppedBytes = image.size()-usedBytes;
+   return schedule;
+}
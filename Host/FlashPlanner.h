@@ -0,0 +1,121 @@
+/**
+ * Flash operation planner
+ *
+ *  Converts a sparse image into a sequence of flash routine calls for a device:
+ *  - Image data is clipped to flash regions and padded to phrase boundaries with the erased value
+ *  - Runs of erased-value phrases are not programmed when a separate call is cheaper
+ *  - Small gaps are merged when that is cheaper than an extra call
+ *  - Program calls are split to fit the routine's data buffer
+ *  - Erase is fused with the first program call of each sector range where possible,
+ *    or done as a block erase when that is cheaper (EraseFastest) or required (EraseAll)
+ *
+ *  Each call carries an estimated cost so schedules built with different options (or
+ *  different routines) may be compared without a target.
+ */
+#ifndef FLASH_PLANNER_H
+#define FLASH_PLANNER_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "FlashProtocol.h"
+#include "SparseImage.h"
+
+/** Flash region of device (one flash block or part of one with uniform sectors) */
+struct FlashRegion {
+   uint32_t start;          // Start address
+   uint32_t size;           // Size (bytes)
+   uint32_t sectorSize;     // Erase unit (bytes, 0 => RoutineInfo.sectorSize)
+   uint32_t phraseSize;     // Program unit (bytes, 0 => RoutineInfo.phraseSize)
+   uint8_t  erasedValue;    // Value of erased flash
+   bool     blockErasable;  // Region may be erased as a whole by DO_ERASE_BLOCK
+};
+
+/** Per-operation cost (any consistent unit e.g. microseconds) */
+struct CommandCosts {
+   double callOverhead   = 0; // Load parameters, start routine and poll for completion
+   double transferByte   = 0; // Download one byte of data to target buffer
+   double eraseSector    = 0; // Erase one sector
+   double eraseBlock     = 0; // Erase one block
+   double programPhrase  = 0; // Program one phrase
+   double verifyByte     = 0; // Verify one byte
+   double blankCheckByte = 0; // Blank check one byte
+};
+
+/** Planning options */
+struct PlanOptions {
+   enum EraseMode {
+      EraseNone,       // Flash is already erased
+      EraseSelective,  // Erase only sectors containing image data
+      EraseAll,        // Erase every region containing image data
+      EraseFastest,    // As EraseSelective or EraseAll, whichever is cheaper (contents outside image are not kept)
+   };
+   EraseMode eraseMode  = EraseSelective;
+   bool      blankCheck = false; // Blank check after erase
+   bool      verify     = true;  // Verify after programming
+   bool      skipErased = true;  // Don't program phrases holding the erased value
+};
+
+/** Single call of flash routine */
+struct PlannedCall {
+   uint32_t             flags;       // FlashData_t.flags (DO_xxx)
+   uint32_t             address;     // FlashData_t.address
+   uint32_t             size;        // FlashData_t.dataSize
+   uint32_t             sectorSize;  // FlashData_t.sectorSize
+   std::vector<uint8_t> data;        // Data to load into buffer (DO_PROGRAM_RANGE/DO_VERIFY_RANGE)
+   double               cost;        // Estimated cost of call
+};
+
+/** Sequence of calls and summary */
+struct Schedule {
+   std::vector<PlannedCall> calls;
+   double   cost            = 0; // Estimated total cost
+   uint64_t programmedBytes = 0; // Bytes programmed (including padding and merged gaps)
+   uint64_t paddingBytes    = 0; // Bytes programmed that are not in image
+   uint64_t skippedBytes    = 0; // Image bytes not programmed as they hold the erased value
+   uint64_t erasedBytes     = 0; // Bytes erased
+   uint64_t droppedBytes    = 0; // Image bytes outside all regions
+};
+
+class FlashPlanner {
+public:
+   /**
+    * @param regions Flash regions of device
+    * @param routine Description of the flash routine (from gFlashProgramHeader)
+    * @param costs   Per-operation costs
+    */
+   FlashPlanner(const std::vector<FlashRegion> &regions, const RoutineInfo &routine, const CommandCosts &costs);
+
+   /**
+    * Create schedule to program image
+    *
+    * @param image   Image to program
+    * @param options Planning options
+    *
+    * @return Schedule
+    *
+    * @throws std::invalid_argument if the routine lacks an operation required by options
+    */
+   Schedule plan(const SparseImage &image, const PlanOptions &options) const;
+
+   /**
+    * Estimate cost of a call
+    *
+    * @param call Call to estimate (flags, address and size are used)
+    */
+   double estimate(const PlannedCall &call) const;
+
+private:
+   std::vector<FlashRegion> regions;
+   RoutineInfo              routine;
+   CommandCosts             costs;
+
+   uint32_t phraseSizeOf(const FlashRegion &region) const;
+   uint32_t sectorSizeOf(const FlashRegion &region) const;
+   const FlashRegion *regionOf(uint32_t address) const;
+
+   void planRegion(const FlashRegion &region, const SparseImage &image, const PlanOptions &options, Schedule &schedule) const;
+   PlannedCall &addCall(Schedule &schedule, const FlashRegion &region, uint32_t flags, uint32_t address, uint32_t size) const;
+};
+
+#endif // FLASH_PLANNER_H
@@ -0,0 +1,153 @@
+/**
+ * Host view of the flash routine interface
+ *
+ *  These values mirror the definitions in each routine's Sources/main.c
+ *  (FlashData_t.flags, FlashProgramHeader_t.capabilities and CAP_HEADER_V2 records).
+ */
+#ifndef FLASH_PROTOCOL_H
+#define FLASH_PROTOCOL_H
+
+#include <stdint.h>
+
+// FlashData_t.flags - operations requested of routine
+#define DO_INIT_FLASH         (1UL<<0)  // Do initialisation of flash
+#define DO_ERASE_BLOCK        (1UL<<1)  // Erase entire flash block e.g. Flash, FlexNVM etc
+#define DO_ERASE_RANGE        (1UL<<2)  // Erase range (including option region)
+#define DO_BLANK_CHECK_RANGE  (1UL<<3)  // Blank check region
+#define DO_PROGRAM_RANGE      (1UL<<4)  // Program range (including option region)
+#define DO_VERIFY_RANGE       (1UL<<5)  // Verify range
+#define DO_PARTITION_FLEXNVM  (1UL<<7)  // Program FlexNVM DFLASH/EEPROM partitioning
+#define DO_TIMING_LOOP        (1UL<<8)  // Counting loop to determine clock speed
+#define DO_FILL_RANGE         (1UL<<11) // Program range with FlashData_t.fillPattern (no data transferred)
+#define DO_UPDATE_EEPROM      (1UL<<13) // Update EEPROM (write only changed bytes)
+#define DO_RECORD_COUNTERS    (1UL<<14) // Record performance counters in FlashData_t
+#define DO_SCAN_ERRORS        (1UL<<24) // Record verify/blank check failures in failMap and continue
+#define DO_COPY_RANGE         (1UL<<25) // Program range from FlashData_t.dataAddress in flash (copy on target)
+#define DO_BACKGROUND_VERIFY  (1UL<<26) // Verify background range while erasing (read-while-write)
+#define DO_SIZE_BUFFER        (1UL<<27) // Report largest free RAM region after image in dataAddress/dataSize
+#define DO_FLEXRAM_BUFFER     (1UL<<28) // Report FlexRAM (if available as RAM) in dataAddress/dataSize
+
+#define IS_COMPLETE           (1UL<<31)
+
+// FlashProgramHeader_t.capabilities
+#define CAP_RESIDENT_AGENT     (1UL<<0)  // FlashProgramHeader_t.agentEntry is valid (see Resident agent below)
+#define CAP_ERASE_BLOCK        (1UL<<1)
+#define CAP_ERASE_RANGE        (1UL<<2)
+#define CAP_BLANK_CHECK_RANGE  (1UL<<3)
+#define CAP_PROGRAM_RANGE      (1UL<<4)
+#define CAP_VERIFY_RANGE       (1UL<<5)
+#define CAP_UNLOCK_FLASH       (1UL<<6)
+#define CAP_PARTITION_FLEXNVM  (1UL<<7)
+#define CAP_TIMING             (1UL<<8)
+#define CAP_FILL_RANGE         (1UL<<9)
+#define CAP_HEADER_V2          (1UL<<10) // FlashProgramHeader_t.info is valid
+#define CAP_DSC_OVERLAY        (1UL<<11) // DSC code in pMEM overlays xRAM
+#define CAP_DATA_FIXED         (1UL<<12) // FlashProgramHeader_t.flashData preset to fixed FlashData_t (host writes there)
+#define CAP_UPDATE_EEPROM      (1UL<<13)
+#define CAP_RECORD_COUNTERS    (1UL<<14)
+#define CAP_SCAN_ERRORS        (1UL<<24)
+#define CAP_COPY_RANGE         (1UL<<25)
+#define CAP_BACKGROUND_VERIFY  (1UL<<26)
+#define CAP_SELF_CHECK         (1UL<<27) // FlashProgramHeader_t.buildHash and selfCheck are valid
+#define CAP_SIZE_BUFFER        (1UL<<28) // DO_SIZE_BUFFER (FlashData_t.address = end of RAM or 0 to probe)
+#define CAP_FLEXRAM_BUFFER     (1UL<<29) // DO_FLEXRAM_BUFFER (data at start of FlexRAM is programmed by F_PGMSEC)
+#define CAP_RELOCATABLE        (1UL<<31)
+
+// Information records (CAP_HEADER_V2)
+#define INFO_END             (0) // End of list
+#define INFO_VERSION         (1) // Header version
+#define INFO_PHRASE_SIZE     (2) // Minimum program unit (bytes)
+#define INFO_SECTOR_SIZE     (3) // Minimum erase unit (bytes)
+#define INFO_BUFFER_ADDRESS  (4) // First free location after image (suitable for data buffer)
+#define INFO_BUFFER_SIZE     (5) // Largest dataSize accepted by a single call (bytes)
+#define INFO_OPERATIONS      (6) // Supported operations (CAP_xxx mask)
+#define INFO_CLOCK           (7) // Clock requirement (INFO_CLOCK_xxx or assumed bus clock in kHz)
+#define INFO_ENDIAN          (8) // Byte order (INFO_ENDIAN_xxx)
+#define INFO_ADDRESS_UNIT    (9) // Size of addressable unit (bytes)
+#define INFO_CHECK_START     (10) // Start of range covered by FlashProgramHeader_t.buildHash
+#define INFO_CHECK_END       (11) // End of range covered by FlashProgramHeader_t.buildHash
+
+#define INFO_ENDIAN_LITTLE   (0)
+#define INFO_ENDIAN_BIG      (1)
+
+// Size of FlashData_t.fillPattern (DO_FILL_RANGE)
+#define FILL_PATTERN_SIZE  (8)
+
+/**
+ * Expand pattern to the value loaded into FlashData_t.fillPattern
+ *
+ * The pattern is repeated in target memory order so pattern[0] lands at the start of the range.
+ *
+ * @param pattern Pattern bytes in target memory order
+ * @param size    Size of pattern (1, 2, 4 or 8 bytes)
+ * @param fill    Where to place expanded pattern
+ *
+ * @return false if size is not supported
+ */
+inline bool expandFillPattern(const uint8_t *pattern, unsigned size, uint8_t fill[FILL_PATTERN_SIZE]) {
+   if ((size == 0) || (size > FILL_PATTERN_SIZE) || ((FILL_PATTERN_SIZE%size) != 0)) {
+      return false;
+   }
+   for (unsigned index=0; index<FILL_PATTERN_SIZE; index++) {
+      fill[index] = pattern[index%size];
+   }
+   return true;
+}
+
+// FlashData_t.familyHint for the single Kinetis FTFx image (FtfxAutoTraits)
+#define FTFX_HINT_DETECT       (0) // Routine detects family
+#define FTFX_HINT_FTFA_MK      (1)
+#define FTFX_HINT_FTFA_MKL     (2)
+#define FTFX_HINT_FTFA_MKM     (3) // Not detected
+#define FTFX_HINT_FTFA_MKV10   (4)
+#define FTFX_HINT_FTFE_MK      (5) // Not detected
+#define FTFX_HINT_FTFE_MKE     (6)
+#define FTFX_HINT_FTFE_MKE18   (7) // Not detected
+#define FTFX_HINT_FTFL_MK      (8)
+
+// Offsets of FlashProgramHeader_t fields (32-bit targets)
+#define HEADER_AGENT_ENTRY_OFFSET (12) // agentEntry (CAP_RESIDENT_AGENT)
+#define HEADER_FLASH_DATA_OFFSET  (20) // flashData
+#define HEADER_BUILD_HASH_OFFSET  (24) // buildHash (CAP_SELF_CHECK)
+#define HEADER_SELF_CHECK_OFFSET  (28) // selfCheck (CAP_SELF_CHECK)
+
+/*
+ * Resident agent (CAP_RESIDENT_AGENT)
+ *
+ * The host starts the target once at agentEntry (read from HEADER_AGENT_ENTRY_OFFSET) and
+ * then drives it by memory accesses only - the core is not halted between requests:
+ *   - Wait for IS_COMPLETE to be set in FlashData_t.flags (agent ready/previous request done)
+ *   - Write FlashData_t (and data buffer) with IS_COMPLETE clear in flags - flags is written last
+ *   - Wait for IS_COMPLETE to be set again, then read FlashData_t.errorCode (and any results)
+ * To return to single calls halt the target and start it at FlashProgramHeader_t.entry as usual.
+ */
+
+/**
+ * What the host knows about a loaded flash routine
+ *
+ * Filled from FlashProgramHeader_t.capabilities and, if CAP_HEADER_V2, the information records.
+ */
+struct RoutineInfo {
+   uint32_t capabilities  = 0;           // CAP_xxx mask
+   uint32_t phraseSize    = 1;           // Minimum program unit (bytes)
+   uint32_t sectorSize    = 0;           // Minimum erase unit (bytes, 0 => from device geometry)
+   uint32_t bufferAddress = 0;           // Target address of data buffer
+   uint32_t bufferSize    = 0xFFFFFFFF;  // Largest dataSize accepted by a single call
+   bool     bigEndian     = false;       // Target byte order
+   uint32_t addressUnit   = 1;           // Size of addressable unit (bytes)
+   uint32_t checkStart    = 0;           // Start of range covered by buildHash (CAP_SELF_CHECK)
+   uint32_t checkEnd      = 0;           // End of range covered by buildHash (CAP_SELF_CHECK)
+
+   /**
+    * Update from CAP_HEADER_V2 information records
+    *
+    * @param records   Records as read from target (target byte order)
+    * @param length    Size of records (bytes)
+    * @param bigEndian Target byte order
+    *
+    * @return false if the list is not terminated by INFO_END within length
+    */
+   bool applyInfoRecords(const uint8_t *records, uint32_t length, bool bigEndian);
+};
+
+#endif // FLASH_PROTOCOL_H
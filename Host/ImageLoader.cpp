@@ -0,0 +1,391 @@
+/**
+ * S-record / Intel-HEX image loader
+ *
+ *  See ImageLoader.h
+ */
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define HAVE_SSE2
+#endif
+
+#include "ImageLoader.h"
+
+/*==========================================================================================================
+ * MappedFile
+ */
+#if defined(_WIN32)
+MappedFile::MappedFile(const char *path) {
+   fileHandle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+   if (fileHandle == INVALID_HANDLE_VALUE) {
+      fileHandle = nullptr;
+      throw std::runtime_error(std::string("Failed to open ")+path);
+   }
+   LARGE_INTEGER fileSize;
+   if (!GetFileSizeEx(fileHandle, &fileSize)) {
+      CloseHandle(fileHandle);
+      throw std::runtime_error(std::string("Failed to get size of ")+path);
+   }
+   length = (size_t)fileSize.QuadPart;
+   if (length == 0) {
+      return;
+   }
+   mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+   if (mappingHandle != nullptr) {
+      contents = (const char *)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+   }
+   if (contents == nullptr) {
+      if (mappingHandle != nullptr) {
+         CloseHandle(mappingHandle);
+      }
+      CloseHandle(fileHandle);
+      throw std::runtime_error(std::string("Failed to map ")+path);
+   }
+}
+
+MappedFile::~MappedFile() {
+   if (contents != nullptr) {
+      UnmapViewOfFile(contents);
+   }
+   if (mappingHandle != nullptr) {
+      CloseHandle(mappingHandle);
+   }
+   if (fileHandle != nullptr) {
+      CloseHandle(fileHandle);
+   }
+}
+#else
+MappedFile::MappedFile(const char *path) {
+   int fd = open(path, O_RDONLY);
+   if (fd < 0) {
+      throw std::runtime_error(std::string("Failed to open ")+path);
+   }
+   struct stat status;
+   if (fstat(fd, &status) != 0) {
+      close(fd);
+      throw std::runtime_error(std::string("Failed to get size of ")+path);
+   }
+   length = (size_t)status.st_size;
+   if (length != 0) {
+      void *mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (mapping == MAP_FAILED) {
+         close(fd);
+         throw std::runtime_error(std::string("Failed to map ")+path);
+      }
+      contents = (const char *)mapping;
+   }
+   close(fd);
+}
+
+MappedFile::~MappedFile() {
+   if (contents != nullptr) {
+      munmap((void *)contents, length);
+   }
+}
+#endif
+
+namespace {
+
+/*==========================================================================================================
+ * Hex digit decoding
+ */
+int hexValue(char ch) {
+   if ((ch >= '0') && (ch <= '9')) {
+      return ch-'0';
+   }
+   if ((ch >= 'A') && (ch <= 'F')) {
+      return ch-'A'+10;
+   }
+   if ((ch >= 'a') && (ch <= 'f')) {
+      return ch-'a'+10;
+   }
+   return -1;
+}
+
+/**
+ * Decode pairs of hex digits
+ *
+ * @param src   Hex digits (2*count)
+ * @param count Number of bytes to produce
+ * @param dst   Where to place bytes
+ *
+ * @return false if a non-hex character was found
+ */
+bool decodeHex(const char *src, size_t count, uint8_t *dst) {
+#if defined(HAVE_SSE2)
+   // 16 digits => 8 bytes per iteration
+   const __m128i lowNibble = _mm_set1_epi8(0x0F);
+   const __m128i one       = _mm_set1_epi8(0x01);
+   const __m128i lowByte   = _mm_set1_epi16(0x00FF);
+   for (; count >= 8; count -= 8, src += 16, dst += 8) {
+      __m128i chars = _mm_loadu_si128((const __m128i *)src);
+
+      // Characters >= 0x80 are negative so fail all range checks
+      __m128i isDigit = _mm_and_si128(_mm_cmpgt_epi8(chars, _mm_set1_epi8('0'-1)), _mm_cmplt_epi8(chars, _mm_set1_epi8('9'+1)));
+      __m128i isUpper = _mm_and_si128(_mm_cmpgt_epi8(chars, _mm_set1_epi8('A'-1)), _mm_cmplt_epi8(chars, _mm_set1_epi8('F'+1)));
+      __m128i isLower = _mm_and_si128(_mm_cmpgt_epi8(chars, _mm_set1_epi8('a'-1)), _mm_cmplt_epi8(chars, _mm_set1_epi8('f'+1)));
+      if (_mm_movemask_epi8(_mm_or_si128(isDigit, _mm_or_si128(isUpper, isLower))) != 0xFFFF) {
+         return false;
+      }
+      // value = (ch & 0x0F) + 9*(letter), letter = bit 6 of ch
+      __m128i letter = _mm_and_si128(_mm_srli_epi16(chars, 6), one);
+      __m128i values = _mm_add_epi8(_mm_and_si128(chars, lowNibble), _mm_add_epi8(_mm_slli_epi16(letter, 3), letter));
+
+      // Combine nibble pairs (high nibble first) and pack to bytes
+      __m128i bytes = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(values, lowByte), 4), _mm_srli_epi16(values, 8));
+      _mm_storel_epi64((__m128i *)dst, _mm_packus_epi16(bytes, _mm_setzero_si128()));
+   }
+#endif
+   for (; count > 0; count--, src += 2) {
+      int high = hexValue(src[0]);
+      int low  = hexValue(src[1]);
+      if ((high < 0) || (low < 0)) {
+         return false;
+      }
+      *dst++ = (uint8_t)((high<<4)|low);
+   }
+   return true;
+}
+
+/*==========================================================================================================
+ * Chunk decoding
+ */
+
+/** Contiguous data decoded from a chunk */
+struct Run {
+   uint32_t             address;
+   bool                 relative;  // Intel-HEX data before first extended address record of chunk
+   std::vector<uint8_t> data;
+};
+
+/** Result of decoding a chunk */
+struct Chunk {
+   const char       *start;
+   const char       *end;
+   unsigned          addressUnit;       // Size of addressable unit used by record addresses
+   std::vector<Run>  runs;
+   bool              baseKnown = false; // Chunk contains an extended address record
+   uint32_t          base      = 0;     // Intel-HEX extended address at end of chunk
+   unsigned          lines     = 0;
+   unsigned          errorLine = 0;
+   std::string       error;
+};
+
+/**
+ * Add data to chunk extending the current run if contiguous
+ *
+ * @param address Record address (converted to byte address)
+ */
+void addData(Chunk &chunk, uint32_t address, bool relative, const uint8_t *data, size_t size) {
+   if (size == 0) {
+      return;
+   }
+   address *= chunk.addressUnit;
+   if (!chunk.runs.empty()) {
+      Run &run = chunk.runs.back();
+      if ((run.relative == relative) && ((uint64_t)run.address+run.data.size() == address)) {
+         run.data.insert(run.data.end(), data, data+size);
+         return;
+      }
+   }
+   chunk.runs.push_back(Run{address, relative, std::vector<uint8_t>(data, data+size)});
+}
+
+/**
+ * Decode one line
+ *
+ * @return nullptr on success or error message
+ */
+const char *decodeLine(Chunk &chunk, const char *line, size_t length) {
+   uint8_t record[5+255]; // Largest Intel-HEX record (largest S-record is 1+255)
+
+   if (line[0] == 'S') {
+      // Stnnaaaa[dd...]cc
+      if ((length < 4) || ((length%2) != 0)) {
+         return "Malformed S-record";
+      }
+      size_t count = (length-2)/2;
+      if (count > 1+255U) {
+         return "S-record too long";
+      }
+      if (!decodeHex(line+2, count, record)) {
+         return "Invalid hex digit";
+      }
+      if ((record[0]+1U) != count) {
+         return "S-record length mismatch";
+      }
+      uint8_t sum = 0;
+      for (size_t index=0; index<count; index++) {
+         sum += record[index];
+      }
+      if (sum != 0xFF) {
+         return "S-record checksum error";
+      }
+      unsigned addressBytes;
+      switch(line[1]) {
+      case '1': addressBytes = 2; break;
+      case '2': addressBytes = 3; break;
+      case '3': addressBytes = 4; break;
+      case '0': case '5': case '6': case '7': case '8': case '9':
+         return nullptr;
+      default:
+         return "Unknown S-record type";
+      }
+      if (record[0] < addressBytes+1) {
+         return "S-record too short";
+      }
+      uint32_t address = 0;
+      for (unsigned index=1; index<=addressBytes; index++) {
+         address = (address<<8)|record[index];
+      }
+      addData(chunk, address, false, record+1+addressBytes, record[0]-addressBytes-1);
+      return nullptr;
+   }
+   if (line[0] == ':') {
+      // :nnaaaatt[dd...]cc
+      if ((length < 11) || ((length%2) != 1)) {
+         return "Malformed Intel-HEX record";
+      }
+      size_t count = (length-1)/2;
+      if (count > sizeof(record)) {
+         return "Intel-HEX record too long";
+      }
+      if (!decodeHex(line+1, count, record)) {
+         return "Invalid hex digit";
+      }
+      if ((record[0]+5U) != count) {
+         return "Intel-HEX record length mismatch";
+      }
+      uint8_t sum = 0;
+      for (size_t index=0; index<count; index++) {
+         sum += record[index];
+      }
+      if (sum != 0) {
+         return "Intel-HEX checksum error";
+      }
+      uint32_t offset = (record[1]<<8)|record[2];
+      switch(record[3]) {
+      case 0x00: // Data
+         addData(chunk, chunk.base+offset, !chunk.baseKnown, record+4, record[0]);
+         return nullptr;
+      case 0x02: // Extended segment address
+      case 0x04: // Extended linear address
+         if (record[0] != 2) {
+            return "Malformed Intel-HEX address record";
+         }
+         chunk.base      = ((record[4]<<8)|record[5])<<((record[3] == 0x02)?4:16);
+         chunk.baseKnown = true;
+         return nullptr;
+      case 0x01: // End of file
+      case 0x03: // Start segment address
+      case 0x05: // Start linear address
+         return nullptr;
+      default:
+         return "Unknown Intel-HEX record type";
+      }
+   }
+   return "Unrecognised record";
+}
+
+void decodeChunk(Chunk &chunk) {
+   const char *position = chunk.start;
+   while (position < chunk.end) {
+      const char *lineEnd = std::find(position, chunk.end, '\n');
+      const char *trimmed = lineEnd;
+      while ((trimmed > position) && ((trimmed[-1] == '\r') || (trimmed[-1] == ' ') || (trimmed[-1] == '\t'))) {
+         trimmed--;
+      }
+      chunk.lines++;
+      if (trimmed > position) {
+         const char *message = decodeLine(chunk, position, trimmed-position);
+         if (message != nullptr) {
+            chunk.error     = message;
+            chunk.errorLine = chunk.lines;
+            return;
+         }
+      }
+      position = (lineEnd < chunk.end)?lineEnd+1:lineEnd;
+   }
+}
+
+} // namespace
+
+void decodeImage(const char *text, size_t length, SparseImage &image, unsigned threads, unsigned addressUnit) {
+   static constexpr size_t minChunkSize = 256*1024;
+
+   if (threads == 0) {
+      threads = std::max(std::thread::hardware_concurrency(), 1U);
+   }
+   threads = (unsigned)std::max<size_t>(std::min<size_t>(threads, length/minChunkSize), 1);
+
+   // Split at line boundaries
+   std::vector<Chunk> chunks(threads);
+   const char *textEnd  = text+length;
+   const char *position = text;
+   for (unsigned index=0; index<threads; index++) {
+      const char *end = (index == threads-1)?textEnd:std::find(text+(length*(index+1))/threads, textEnd, '\n');
+      if (end < textEnd) {
+         end++;
+      }
+      end = std::max(end, position);
+      chunks[index].start       = position;
+      chunks[index].end         = end;
+      chunks[index].addressUnit = addressUnit;
+      position = end;
+   }
+   if (threads == 1) {
+      decodeChunk(chunks[0]);
+   }
+   else {
+      std::vector<std::thread> workers;
+      for (Chunk &chunk : chunks) {
+         workers.emplace_back(decodeChunk, std::ref(chunk));
+      }
+      for (std::thread &worker : workers) {
+         worker.join();
+      }
+   }
+
+   // Combine in file order resolving Intel-HEX addresses that depend on earlier chunks
+   unsigned lineBase = 0;
+   uint32_t base     = 0;
+   for (Chunk &chunk : chunks) {
+      if (!chunk.error.empty()) {
+         throw std::runtime_error(chunk.error+" at line "+std::to_string(lineBase+chunk.errorLine));
+      }
+      for (Run &run : chunk.runs) {
+         image.add(run.relative?base*addressUnit+run.address:run.address, std::move(run.data));
+      }
+      if (chunk.baseKnown) {
+         base = chunk.base;
+      }
+      lineBase += chunk.lines;
+   }
+}
+
+SparseImage loadImageFile(const char *path, unsigned threads, unsigned addressUnit) {
+   MappedFile  file(path);
+   SparseImage image;
+
+   try {
+      decodeImage(file.data(), file.size(), image, threads, addressUnit);
+   }
+   catch (std::runtime_error &e) {
+      throw std::runtime_error(std::string(path)+": "+e.what());
+   }
+   return image;
+}
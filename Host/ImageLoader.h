@@ -0,0 +1,76 @@
+/**
+ * S-record / Intel-HEX image loader
+ *
+ *  The file is memory mapped and split at line boundaries into chunks that are
+ *  decoded in parallel.  Each chunk builds contiguous runs of data that are moved
+ *  into the SparseImage so gaps (e.g. 0xFF padding) are never materialised and
+ *  each extent is a single buffer suitable for FlashData_t.dataAddress.
+ *
+ *  Record formats are detected per line so the mixed files in GeneratedFiles
+ *  (.hex files holding S-records, .S19, .sx, DSC .elf.p.S) are all accepted.
+ *  Image addresses are always byte addresses.  Files using word addresses
+ *  (DSC .elf.p.S) are loaded with addressUnit = 2.
+ */
+#ifndef IMAGE_LOADER_H
+#define IMAGE_LOADER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "SparseImage.h"
+
+/**
+ * Read-only memory mapping of a file
+ */
+class MappedFile {
+public:
+   /**
+    * @param path Path to file
+    *
+    * @throws std::runtime_error if the file cannot be opened or mapped
+    */
+   explicit MappedFile(const char *path);
+   ~MappedFile();
+
+   MappedFile(const MappedFile &) = delete;
+   MappedFile &operator=(const MappedFile &) = delete;
+
+   const char *data() const { return contents; }
+   size_t      size() const { return length; }
+
+private:
+   const char *contents = nullptr;
+   size_t      length   = 0;
+#if defined(_WIN32)
+   void       *fileHandle    = nullptr;
+   void       *mappingHandle = nullptr;
+#endif
+};
+
+/**
+ * Decode S-record or Intel-HEX text into image
+ *
+ * @param text        Text to decode
+ * @param length      Length of text
+ * @param image       Image to add data to
+ * @param threads     Number of decoding threads (0 => hardware concurrency, small inputs use 1)
+ * @param addressUnit Size of addressable unit used by record addresses (bytes)
+ *
+ * @throws std::runtime_error on malformed record or checksum error (message includes line number)
+ */
+void decodeImage(const char *text, size_t length, SparseImage &image, unsigned threads=0, unsigned addressUnit=1);
+
+/**
+ * Load S-record or Intel-HEX file
+ *
+ * @param path        Path to file
+ * @param threads     Number of decoding threads (0 => hardware concurrency, small files use 1)
+ * @param addressUnit Size of addressable unit used by record addresses (bytes)
+ *
+ * @return Image
+ *
+ * @throws std::runtime_error on file or format error
+ */
+SparseImage loadImageFile(const char *path, unsigned threads=0, unsigned addressUnit=1);
+
+#endif // IMAGE_LOADER_H
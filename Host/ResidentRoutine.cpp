@@ -0,0 +1,71 @@
+/**
+ * Resident routine detection (CAP_SELF_CHECK)
+ *
+ *  See ResidentRoutine.h
+ */
+#include <algorithm>
+#include <stdexcept>
+
+#include "Crc32.h"
+#include "ResidentRoutine.h"
+
+namespace {
+
+uint32_t readValue(const uint8_t *data, bool bigEndian) {
+   return bigEndian?
+      ((uint32_t)data[0]<<24)|((uint32_t)data[1]<<16)|((uint32_t)data[2]<<8)|data[3]:
+      ((uint32_t)data[3]<<24)|((uint32_t)data[2]<<16)|((uint32_t)data[1]<<8)|data[0];
+}
+
+void writeValue(uint8_t *data, uint32_t value, bool bigEndian) {
+   for (int index=0; index<4; index++) {
+      data[bigEndian?(3-index):index] = (uint8_t)(value>>(8*index));
+   }
+}
+
+bool isPresent(const SparseImage &image, uint32_t address, uint32_t size) {
+   for (const auto &extent : image) {
+      if ((address >= extent.first) && ((uint64_t)address+size <= (uint64_t)extent.first+extent.second.size())) {
+         return true;
+      }
+   }
+   return false;
+}
+
+} // namespace
+
+uint32_t routineBuildHash(const SparseImage &image, uint32_t checkStart, uint32_t checkEnd) {
+   uint32_t crc = 0;
+   uint8_t  buffer[1024];
+   for (uint32_t address=checkStart; address<checkEnd; ) {
+      uint32_t size = std::min<uint32_t>(sizeof(buffer), checkEnd-address);
+      image.read(address, size, 0xFF, buffer);
+      crc      = crc32(buffer, size, crc);
+      address += size;
+   }
+   return crc;
+}
+
+ResidentImage stampBuildHash(SparseImage &image, uint32_t headerAddress, const RoutineInfo &routine) {
+   if (((routine.capabilities&CAP_SELF_CHECK) == 0) || (routine.checkEnd <= routine.checkStart)) {
+      throw std::invalid_argument("Routine does not support self-check");
+   }
+   uint32_t hashAddress = headerAddress+HEADER_BUILD_HASH_OFFSET;
+   if (!isPresent(image, headerAddress, HEADER_SELF_CHECK_OFFSET+4)) {
+      throw std::invalid_argument("Routine header not in image");
+   }
+   if ((hashAddress+4 > routine.checkStart) && (hashAddress < routine.checkEnd)) {
+      throw std::invalid_argument("Routine header inside self-check range");
+   }
+   uint8_t field[4];
+   image.read(headerAddress+HEADER_SELF_CHECK_OFFSET, 4, 0xFF, field);
+
+   ResidentImage resident;
+   resident.headerAddress = headerAddress;
+   resident.buildHash     = routineBuildHash(image, routine.checkStart, routine.checkEnd);
+   resident.selfCheck     = readValue(field, routine.bigEndian);
+
+   writeValue(field, resident.buildHash, routine.bigEndian);
+   image.add(hashAddress, field, sizeof(field));
+   return resident;
+}
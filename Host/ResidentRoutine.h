@@ -0,0 +1,57 @@
+/**
+ * Resident routine detection (CAP_SELF_CHECK)
+ *
+ *  A routine left in target RAM by an earlier session can be re-used instead of
+ *  being loaded again.  Before loading, the host stamps a CRC-32 of the routine's
+ *  code and constants ([INFO_CHECK_START, INFO_CHECK_END)) into
+ *  FlashProgramHeader_t.buildHash.  The header lies outside the checked range so
+ *  stamping does not change the hash.
+ *
+ *  On the next session:
+ *     1. Read the 32-bit value at headerAddress+HEADER_BUILD_HASH_OFFSET.
+ *        If it differs from ResidentImage.buildHash, load the image as usual.
+ *     2. Otherwise set FlashProgramHeader_t.flashData and execute from selfCheck.
+ *        The routine recalculates the CRC over the RAM copy and completes with
+ *        errorCode = 0 (intact) or a verify error (damaged).
+ *     3. If intact, skip the load.  Otherwise load the image as usual.
+ */
+#ifndef RESIDENT_ROUTINE_H
+#define RESIDENT_ROUTINE_H
+
+#include <stdint.h>
+
+#include "FlashProtocol.h"
+#include "SparseImage.h"
+
+/** Values used to decide if a routine is already resident */
+struct ResidentImage {
+   uint32_t headerAddress;     // Target address of FlashProgramHeader_t
+   uint32_t buildHash;         // Expected FlashProgramHeader_t.buildHash
+   uint32_t selfCheck;         // Target address of self-check entry point
+};
+
+/**
+ * Calculate build hash of routine image
+ *
+ * @param image      Routine image (byte addresses)
+ * @param checkStart Start of range (INFO_CHECK_START)
+ * @param checkEnd   End of range (INFO_CHECK_END)
+ *
+ * @return CRC-32 of range (locations not present in image are taken as 0xFF)
+ */
+uint32_t routineBuildHash(const SparseImage &image, uint32_t checkStart, uint32_t checkEnd);
+
+/**
+ * Stamp build hash into routine image before loading
+ *
+ * @param image         Routine image (byte addresses), updated with buildHash
+ * @param headerAddress Target address of FlashProgramHeader_t
+ * @param routine       Routine information (from header and information records)
+ *
+ * @return Values needed to detect the image on a later session
+ *
+ * @throws std::invalid_argument if routine does not support CAP_SELF_CHECK or header is not in image
+ */
+ResidentImage stampBuildHash(SparseImage &image, uint32_t headerAddress, const RoutineInfo &routine);
+
+#endif // RESIDENT_ROUTINE_H
@@ -0,0 +1,293 @@
+/**
+ * Indexed bundle of flash routine images
+ *
+ *  See RoutineBundle.h
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdexcept>
+
+#include "Crc32.h"
+#include "RoutineBundle.h"
+
+namespace {
+
+/** How FlashProgramHeader_t is located and decoded for each architecture */
+struct ArchInfo {
+   const char *family;         // Family name as used in GeneratedFiles
+   bool        bigEndian;      // Target byte order
+   uint8_t     addressUnit;    // Size of addressable unit (bytes)
+   uint8_t     pointerSize;    // Size of pointer to header at start of image (0 => header at start)
+   uint8_t     loadOffset;     // Offset of loadAddress in header (bytes)
+   uint8_t     entryOffset;    // Offset of entry in header (bytes)
+   uint8_t     capsOffset;     // Offset of capabilities in header (bytes)
+   uint8_t     pointerFieldSize; // Size of loadAddress and entry (bytes)
+   uint8_t     capsSize;         // Size of capabilities (bytes)
+};
+
+const ArchInfo archInfo[] = {
+   /* ARM   */ {"ARM",   false, 1, 4, 0, 4, 8, 4, 4},
+   /* CFV1  */ {"CFV1",  true,  1, 4, 0, 4, 8, 4, 4},
+   /* CFVX  */ {"CFVx",  true,  1, 4, 0, 4, 8, 4, 4},
+   /* HCS08 */ {"HCS08", true,  1, 2, 0, 2, 4, 2, 2},
+   /* S12Z  */ {"S12Z",  true,  1, 0, 0, 4, 8, 4, 4},
+   /* DSC   */ {"DSC",   false, 2, 4, 0, 4, 8, 4, 2},
+};
+
+/**
+ * Read value from image
+ *
+ * @return false if not present in image
+ */
+bool readImage(const SparseImage &image, const ArchInfo &arch, uint32_t byteAddress, unsigned size, uint32_t &result) {
+   for (const SparseImage::ExtentMap::value_type &extent : image) {
+      uint64_t start = extent.first;
+      if ((byteAddress >= start) && ((uint64_t)byteAddress+size <= start+extent.second.size())) {
+         const uint8_t *value = &extent.second[(size_t)(byteAddress-start)];
+         result = 0;
+         for (unsigned index=0; index<size; index++) {
+            unsigned shift = arch.bigEndian?8*(size-1-index):8*index;
+            result |= (uint32_t)value[index]<<shift;
+         }
+         return true;
+      }
+   }
+   return false;
+}
+
+/**
+ * Check region lies within file
+ *
+ * @param fileSize Size of file
+ * @param offset   File offset of region
+ * @param size     Size of region
+ * @param align    Required alignment of offset
+ */
+bool inFile(size_t fileSize, uint64_t offset, uint64_t size, unsigned align=1) {
+   return ((offset%align) == 0) && (offset <= fileSize) && (size <= fileSize-offset);
+}
+
+/**
+ * Check offset is the start of a nul terminated string within file
+ */
+bool stringInFile(const MappedFile &file, uint32_t offset) {
+   return (offset < file.size()) && (memchr(file.data()+offset, '\0', file.size()-offset) != nullptr);
+}
+
+void append(std::vector<uint8_t> &buffer, const void *data, size_t size) {
+   buffer.insert(buffer.end(), (const uint8_t *)data, (const uint8_t *)data+size);
+}
+
+void alignBuffer(std::vector<uint8_t> &buffer) {
+   buffer.resize((buffer.size()+3)&~(size_t)3);
+}
+
+} // namespace
+
+uint32_t bundleHash(const char *family, const char *name) {
+   // FNV-1a over family, separator and name
+   uint32_t hash = 2166136261UL;
+   for (const char *ptr=family; *ptr != '\0'; ptr++) {
+      hash = (hash^(uint8_t)*ptr)*16777619UL;
+   }
+   hash = (hash^'/')*16777619UL;
+   for (const char *ptr=name; *ptr != '\0'; ptr++) {
+      hash = (hash^(uint8_t)*ptr)*16777619UL;
+   }
+   return hash;
+}
+
+/*==========================================================================================================
+ * RoutineBundle
+ */
+RoutineBundle::RoutineBundle(const char *path) : file(path) {
+   header = (const BundleFileHeader *)file.data();
+   if ((file.size() < sizeof(BundleFileHeader)) || (memcmp(header->magic, BUNDLE_MAGIC, sizeof(BUNDLE_MAGIC)) != 0)) {
+      throw std::runtime_error(std::string(path)+": Not a routine bundle");
+   }
+   if (header->version != BUNDLE_VERSION) {
+      throw std::runtime_error(std::string(path)+": Unsupported bundle version");
+   }
+   if ((header->fileSize != file.size()) ||
+       (crc32((const uint8_t *)file.data()+sizeof(BundleFileHeader), file.size()-sizeof(BundleFileHeader)) != header->crc)) {
+      throw std::runtime_error(std::string(path)+": Bundle is corrupt");
+   }
+   // Hash table must have a free slot so find() terminates
+   if ((header->slotCount == 0) || ((header->slotCount&(header->slotCount-1)) != 0) ||
+       (header->slotCount <= header->entryCount) ||
+       !inFile(file.size(), sizeof(BundleFileHeader), (uint64_t)header->entryCount*sizeof(BundleEntry)) ||
+       !inFile(file.size(), header->slotsOffset, (uint64_t)header->slotCount*sizeof(uint32_t), sizeof(uint32_t))) {
+      throw std::runtime_error(std::string(path)+": Bundle index is invalid");
+   }
+   entries = (const BundleEntry *)(file.data()+sizeof(BundleFileHeader));
+   slots   = (const uint32_t *)(file.data()+header->slotsOffset);
+
+   bool freeSlot = false;
+   for (uint32_t slot=0; slot<header->slotCount; slot++) {
+      if (slots[slot] > header->entryCount) {
+         throw std::runtime_error(std::string(path)+": Bundle index is invalid");
+      }
+      freeSlot = freeSlot || (slots[slot] == 0);
+   }
+   if (!freeSlot) {
+      throw std::runtime_error(std::string(path)+": Bundle index is invalid");
+   }
+   for (uint32_t index=0; index<header->entryCount; index++) {
+      const BundleEntry *entry = entries+index;
+      if (!stringInFile(file, entry->familyOffset) || !stringInFile(file, entry->nameOffset) ||
+          !inFile(file.size(), entry->extentsOffset, (uint64_t)entry->extentCount*sizeof(BundleExtent), sizeof(uint32_t))) {
+         throw std::runtime_error(std::string(path)+": Bundle entry is invalid");
+      }
+      const BundleExtent *extents = extentsOf(entry);
+      for (uint32_t extent=0; extent<entry->extentCount; extent++) {
+         if (!inFile(file.size(), extents[extent].dataOffset, extents[extent].size)) {
+            throw std::runtime_error(std::string(path)+": Bundle entry is invalid");
+         }
+      }
+   }
+}
+
+const BundleEntry *RoutineBundle::find(const char *family, const char *name) const {
+   uint32_t mask = header->slotCount-1;
+   for (uint32_t slot=bundleHash(family, name)&mask; slots[slot] != 0; slot=(slot+1)&mask) {
+      const BundleEntry *candidate = entries+(slots[slot]-1);
+      if ((strcmp(familyOf(candidate), family) == 0) && (strcmp(nameOf(candidate), name) == 0)) {
+         return candidate;
+      }
+   }
+   return nullptr;
+}
+
+/*==========================================================================================================
+ * RoutineBundleWriter
+ */
+void RoutineBundleWriter::add(const std::string &family, const std::string &name, BundleArch arch, const SparseImage &image) {
+   const ArchInfo &info = archInfo[arch];
+
+   if (image.empty()) {
+      throw std::runtime_error(name+": Empty image");
+   }
+   uint32_t imageStart    = image.begin()->first;
+   uint32_t headerAddress = imageStart/info.addressUnit;
+
+   Routine routine;
+   routine.family = family;
+   routine.name   = name;
+   memset(&routine.entry, 0, sizeof(routine.entry));
+   routine.entry.arch        = arch;
+   routine.entry.bigEndian   = info.bigEndian;
+   routine.entry.addressUnit = info.addressUnit;
+
+   bool found = (info.pointerSize == 0) || readImage(image, info, imageStart, info.pointerSize, headerAddress);
+   uint32_t headerStart = headerAddress*info.addressUnit;
+   found = found &&
+      readImage(image, info, headerStart+info.loadOffset,  info.pointerFieldSize, routine.entry.loadAddress) &&
+      readImage(image, info, headerStart+info.entryOffset, info.pointerFieldSize, routine.entry.entry) &&
+      readImage(image, info, headerStart+info.capsOffset,  info.capsSize,         routine.entry.capabilities);
+   if (found) {
+      routine.entry.headerAddress = headerAddress;
+   }
+   else {
+      // Older routines (e.g. HCS08-default infoBlock) have no FlashProgramHeader_t
+      routine.entry.loadAddress   = imageStart/info.addressUnit;
+      routine.entry.entry         = 0;
+      routine.entry.capabilities  = 0;
+      routine.entry.flags         = BUNDLE_ENTRY_LEGACY;
+   }
+   routine.image               = image;
+   routines.push_back(std::move(routine));
+}
+
+void RoutineBundleWriter::addFile(const std::string &family, const std::string &path) {
+   size_t nameStart = path.find_last_of("/\\");
+   nameStart = (nameStart == std::string::npos)?0:nameStart+1;
+   std::string name = path.substr(nameStart, path.find('.', nameStart)-nameStart);
+
+   for (unsigned arch=0; arch<sizeof(archInfo)/sizeof(archInfo[0]); arch++) {
+      if (family == archInfo[arch].family) {
+         add(family, name, (BundleArch)arch, loadImageFile(path.c_str(), 0, archInfo[arch].addressUnit));
+         return;
+      }
+   }
+   throw std::runtime_error(path+": Unknown family "+family);
+}
+
+void RoutineBundleWriter::write(const std::string &path) const {
+   uint32_t slotCount = 1;
+   while (slotCount < 2*routines.size()) {
+      slotCount <<= 1;
+   }
+   uint32_t entryCount    = (uint32_t)routines.size();
+   uint32_t slotsOffset   = (uint32_t)(sizeof(BundleFileHeader)+entryCount*sizeof(BundleEntry));
+   uint32_t extentsOffset = slotsOffset+slotCount*sizeof(uint32_t);
+   uint32_t extentCount   = 0;
+   size_t   stringsSize   = 0;
+   for (const Routine &routine : routines) {
+      extentCount += (uint32_t)std::distance(routine.image.begin(), routine.image.end());
+      stringsSize += routine.family.size()+routine.name.size()+2;
+   }
+   uint32_t stringsOffset = extentsOffset+extentCount*sizeof(BundleExtent);
+   uint32_t dataOffset    = (uint32_t)((stringsOffset+stringsSize+3)&~(size_t)3);
+
+   std::vector<BundleEntry>  entries;
+   std::vector<uint32_t>     slots(slotCount, 0);
+   std::vector<BundleExtent> extents;
+   std::vector<uint8_t>      strings;
+   std::vector<uint8_t>      data;
+   for (const Routine &routine : routines) {
+      BundleEntry entry = routine.entry;
+      entry.familyOffset  = stringsOffset+(uint32_t)strings.size();
+      append(strings, routine.family.c_str(), routine.family.size()+1);
+      entry.nameOffset    = stringsOffset+(uint32_t)strings.size();
+      append(strings, routine.name.c_str(), routine.name.size()+1);
+      entry.extentsOffset = extentsOffset+(uint32_t)(extents.size()*sizeof(BundleExtent));
+      entry.extentCount   = 0;
+      for (const SparseImage::ExtentMap::value_type &extent : routine.image) {
+         uint32_t address = extent.first/routine.entry.addressUnit;
+         extents.push_back(BundleExtent{address, (uint32_t)extent.second.size(), dataOffset+(uint32_t)data.size()});
+         append(data, extent.second.data(), extent.second.size());
+         alignBuffer(data);
+         entry.extentCount++;
+      }
+      uint32_t slot = bundleHash(routine.family.c_str(), routine.name.c_str())&(slotCount-1);
+      while (slots[slot] != 0) {
+         const Routine &other = routines[slots[slot]-1];
+         if ((other.family == routine.family) && (other.name == routine.name)) {
+            throw std::runtime_error(routine.family+"/"+routine.name+": Duplicate routine");
+         }
+         slot = (slot+1)&(slotCount-1);
+      }
+      entries.push_back(entry);
+      slots[slot] = (uint32_t)entries.size();
+   }
+
+   std::vector<uint8_t> contents;
+   BundleFileHeader header;
+   memset(&header, 0, sizeof(header));
+   memcpy(header.magic, BUNDLE_MAGIC, sizeof(BUNDLE_MAGIC));
+   header.version     = BUNDLE_VERSION;
+   header.entryCount  = entryCount;
+   header.slotCount   = slotCount;
+   header.slotsOffset = slotsOffset;
+   append(contents, &header, sizeof(header));
+   append(contents, entries.data(), entries.size()*sizeof(BundleEntry));
+   append(contents, slots.data(), slots.size()*sizeof(uint32_t));
+   append(contents, extents.data(), extents.size()*sizeof(BundleExtent));
+   append(contents, strings.data(), strings.size());
+   alignBuffer(contents);
+   append(contents, data.data(), data.size());
+
+   BundleFileHeader *fileHeader = (BundleFileHeader *)contents.data();
+   fileHeader->fileSize = (uint32_t)contents.size();
+   fileHeader->crc      = crc32(contents.data()+sizeof(BundleFileHeader), contents.size()-sizeof(BundleFileHeader));
+
+   FILE *fp = fopen(path.c_str(), "wb");
+   if (fp == nullptr) {
+      throw std::runtime_error(path+": Failed to create");
+   }
+   bool success = fwrite(contents.data(), 1, contents.size(), fp) == contents.size();
+   success = (fclose(fp) == 0) && success;
+   if (!success) {
+      throw std::runtime_error(path+": Failed to write");
+   }
+}
@@ -0,0 +1,166 @@
+/**
+ * Indexed bundle of flash routine images
+ *
+ *  A single file holding every routine image from GeneratedFiles already decoded,
+ *  together with the FlashProgramHeader_t fields the host needs before loading.
+ *  The file is memory mapped and routines are found by a hash of family and name,
+ *  so no S-record/HEX parsing is needed when a session starts.
+ *
+ *  File layout (all values in host byte order, all sections 4-byte aligned):
+ *     BundleFileHeader
+ *     BundleEntry     entries[entryCount]
+ *     uint32_t        slots[slotCount]      (entry index+1, 0 => empty)
+ *     BundleExtent    extents[]
+ *     char            strings[]             (family and name, nul terminated)
+ *     uint8_t         data[]                (extent contents)
+ *
+ *  The CRC covers everything after BundleFileHeader.
+ *  Structures are used in place from the mapped file so a bundle is only readable on a host
+ *  with the byte order of the host that wrote it (on other hosts the version check fails).
+ */
+#ifndef ROUTINE_BUNDLE_H
+#define ROUTINE_BUNDLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "ImageLoader.h"
+#include "SparseImage.h"
+
+#define BUNDLE_MAGIC    "USBDMRB"
+#define BUNDLE_VERSION  (1)
+
+// BundleEntry.flags
+#define BUNDLE_ENTRY_LEGACY  (1<<0) // Image has no FlashProgramHeader_t (header fields are not valid)
+
+/** Target architecture of routine (selects how FlashProgramHeader_t is found and decoded) */
+enum BundleArch : uint8_t {
+   ARCH_ARM,    // Little-endian, image starts with pointer to header
+   ARCH_CFV1,   // Big-endian, image starts with pointer to header
+   ARCH_CFVX,   // Big-endian, image starts with pointer to header
+   ARCH_HCS08,  // Big-endian, 16-bit pointer to header at start of image
+   ARCH_S12Z,   // Big-endian, header at start of image
+   ARCH_DSC,    // Little-endian 16-bit words, word address of header at start of image
+};
+
+struct BundleFileHeader {
+   char     magic[8];          // BUNDLE_MAGIC
+   uint32_t version;           // BUNDLE_VERSION
+   uint32_t fileSize;          // Size of file (bytes)
+   uint32_t crc;               // CRC-32 of file after this header
+   uint32_t entryCount;        // Number of BundleEntry
+   uint32_t slotCount;         // Size of hash table (power of 2)
+   uint32_t slotsOffset;       // File offset of hash table
+};
+
+struct BundleEntry {
+   uint32_t familyOffset;      // File offset of family name e.g. "ARM"
+   uint32_t nameOffset;        // File offset of routine name e.g. "Kinetis-FTFE-MK-flash-program-gcc"
+   uint32_t extentsOffset;     // File offset of first BundleExtent
+   uint32_t extentCount;       // Number of BundleExtent
+   uint32_t headerAddress;     // Target address of FlashProgramHeader_t
+   uint32_t loadAddress;       // FlashProgramHeader_t.loadAddress
+   uint32_t entry;             // FlashProgramHeader_t.entry
+   uint32_t capabilities;      // FlashProgramHeader_t.capabilities
+   uint8_t  arch;              // BundleArch
+   uint8_t  bigEndian;         // Target byte order
+   uint8_t  addressUnit;       // Size of addressable unit (bytes)
+   uint8_t  flags;             // BUNDLE_ENTRY_xxx
+};
+
+struct BundleExtent {
+   uint32_t address;           // Target address (addressable units)
+   uint32_t size;              // Size (bytes)
+   uint32_t dataOffset;        // File offset of contents
+};
+
+/**
+ * Read access to a bundle
+ *
+ * Entries, extents and data refer directly to the mapped file.
+ */
+class RoutineBundle {
+public:
+   /**
+    * @param path Path to bundle
+    *
+    * @throws std::runtime_error if the file cannot be mapped or fails validation
+    *         (including any count or offset lying outside the file)
+    */
+   explicit RoutineBundle(const char *path);
+
+   /**
+    * Find routine
+    *
+    * @param family Family e.g. "ARM"
+    * @param name   Routine name e.g. "Kinetis-FTFE-MK-flash-program-gcc"
+    *
+    * @return Entry or nullptr if not present
+    */
+   const BundleEntry *find(const char *family, const char *name) const;
+
+   uint32_t            size() const                                  { return header->entryCount; }
+   const BundleEntry  *entry(uint32_t index) const                   { return entries+index; }
+   const char         *familyOf(const BundleEntry *entry) const      { return file.data()+entry->familyOffset; }
+   const char         *nameOf(const BundleEntry *entry) const        { return file.data()+entry->nameOffset; }
+   const BundleExtent *extentsOf(const BundleEntry *entry) const     { return (const BundleExtent *)(file.data()+entry->extentsOffset); }
+   const uint8_t      *dataOf(const BundleExtent *extent) const      { return (const uint8_t *)file.data()+extent->dataOffset; }
+
+private:
+   MappedFile              file;
+   const BundleFileHeader *header;
+   const BundleEntry      *entries;
+   const uint32_t         *slots;
+};
+
+/**
+ * Creates a bundle
+ */
+class RoutineBundleWriter {
+public:
+   /**
+    * Add routine image
+    *
+    * @param family Family e.g. "ARM"
+    * @param name   Routine name
+    * @param arch   Target architecture
+    * @param image  Routine image (byte addresses)
+    *
+    * @throws std::runtime_error if image is empty
+    */
+   void add(const std::string &family, const std::string &name, BundleArch arch, const SparseImage &image);
+
+   /**
+    * Add routine image file
+    *
+    * The routine name is the file name without directory and extensions.
+    * The architecture is deduced from family (ARM, CFV1, CFVx, HCS08, S12Z, DSC).
+    *
+    * @param family Family e.g. "ARM"
+    * @param path   Path to S-record or Intel-HEX file
+    */
+   void addFile(const std::string &family, const std::string &path);
+
+   /**
+    * Write bundle
+    *
+    * @param path Path to bundle
+    */
+   void write(const std::string &path) const;
+
+private:
+   struct Routine {
+      std::string family;
+      std::string name;
+      BundleEntry entry;
+      SparseImage image;
+   };
+   std::vector<Routine> routines;
+};
+
+/** Hash used for bundle index */
+uint32_t bundleHash(const char *family, const char *name);
+
+#endif // ROUTINE_BUNDLE_H
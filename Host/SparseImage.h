@@ -0,0 +1,137 @@
+/**
+ * Sparse memory image
+ *
+ *  Holds the contents of a target image as a set of non-overlapping, non-adjacent extents
+ *  ordered by address.  Data added later replaces earlier data at the same address.
+ */
+#ifndef SPARSE_IMAGE_H
+#define SPARSE_IMAGE_H
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <vector>
+
+class SparseImage {
+public:
+   /** Contiguous run of image data (start address => bytes) */
+   typedef std::map<uint32_t, std::vector<uint8_t>> ExtentMap;
+   typedef ExtentMap::const_iterator                const_iterator;
+
+private:
+   ExtentMap extents;
+
+   static uint64_t endOf(const ExtentMap::value_type &extent) {
+      return (uint64_t)extent.first + extent.second.size();
+   }
+
+public:
+   /**
+    * Add data to image
+    *
+    * Overlapping or adjacent extents are merged.
+    *
+    * @param address Start address
+    * @param data    Data to add
+    * @param size    Number of bytes
+    */
+   void add(uint32_t address, const uint8_t *data, uint32_t size) {
+      if (size == 0) {
+         return;
+      }
+      uint64_t end = (uint64_t)address+size;
+
+      // Find first extent that overlaps or touches [address, end)
+      ExtentMap::iterator first = extents.upper_bound(address);
+      if ((first != extents.begin()) && (endOf(*std::prev(first)) >= address)) {
+         --first;
+      }
+      ExtentMap::iterator last = first;
+      uint32_t mergedStart = address;
+      uint64_t mergedEnd   = end;
+      while ((last != extents.end()) && (last->first <= end)) {
+         mergedStart = std::min(mergedStart, last->first);
+         mergedEnd   = std::max(mergedEnd, endOf(*last));
+         ++last;
+      }
+      if ((first == last) || ((first->first == mergedStart) && (std::next(first) == last))) {
+         // Simple case - new extent, or overwrite/append within a single extent
+         std::vector<uint8_t> &bytes = extents[mergedStart];
+         bytes.resize((size_t)(mergedEnd-mergedStart));
+         memcpy(&bytes[address-mergedStart], data, size);
+         return;
+      }
+      std::vector<uint8_t> merged((size_t)(mergedEnd-mergedStart));
+      for (ExtentMap::iterator it=first; it != last; ++it) {
+         memcpy(&merged[it->first-mergedStart], it->second.data(), it->second.size());
+      }
+      memcpy(&merged[address-mergedStart], data, size);
+      extents.erase(first, last);
+      extents[mergedStart].swap(merged);
+   }
+
+   /**
+    * Add data to image taking ownership of buffer
+    *
+    * The buffer becomes an extent without copying unless it overlaps or touches existing data.
+    *
+    * @param address Start address
+    * @param data    Data to add
+    */
+   void add(uint32_t address, std::vector<uint8_t> &&data) {
+      if (data.empty()) {
+         return;
+      }
+      uint64_t end = (uint64_t)address+data.size();
+      ExtentMap::iterator next = extents.lower_bound(address);
+      bool touchesNext = (next != extents.end()) && (next->first <= end);
+      bool touchesPrev = (next != extents.begin()) && (endOf(*std::prev(next)) >= address);
+      if (touchesNext || touchesPrev) {
+         add(address, data.data(), (uint32_t)data.size());
+         return;
+      }
+      extents[address].swap(data);
+   }
+
+   /**
+    * Read data from image
+    *
+    * @param address Start address
+    * @param size    Number of bytes
+    * @param fill    Value used for locations not present in image
+    * @param buffer  Where to place data
+    */
+   void read(uint32_t address, uint32_t size, uint8_t fill, uint8_t *buffer) const {
+      memset(buffer, fill, size);
+      uint64_t end = (uint64_t)address+size;
+      const_iterator it = extents.upper_bound(address);
+      if (it != extents.begin()) {
+         --it;
+      }
+      for (; (it != extents.end()) && (it->first < end); ++it) {
+         uint64_t from = std::max((uint64_t)address, (uint64_t)it->first);
+         uint64_t to   = std::min(end, endOf(*it));
+         if (from < to) {
+            memcpy(buffer+(from-address), &it->second[(size_t)(from-it->first)], (size_t)(to-from));
+         }
+      }
+   }
+
+   /** Total number of bytes present in image */
+   uint64_t size() const {
+      uint64_t total = 0;
+      for (const_iterator it=extents.begin(); it != extents.end(); ++it) {
+         total += it->second.size();
+      }
+      return total;
+   }
+
+   bool           empty() const { return extents.empty(); }
+   void           clear()       { extents.clear(); }
+   const_iterator begin() const { return extents.begin(); }
+   const_iterator end()   const { return extents.end(); }
+};
+
+#endif // SPARSE_IMAGE_H
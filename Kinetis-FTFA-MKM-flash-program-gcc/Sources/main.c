@@ -8,6 +8,9 @@
  *  MCM_PLACR Flash cache control
  *  NMI       Disabled in SIM_CTRL_REG (move to TCL?)
  *  
+ *  Frozen - kept as the small RAM image for this family (bug fixes only).
+ *  New operations are added to Kinetis-FTFx-flash-program-gcc only.
+ *  
  * History
  *------------------------------------------------------------------------------------------------
  * 16 May 2021 - Fixed boundary address error in erase block                          | V4.11.1.270
@@ -8,6 +8,9 @@
  *  MCM_PLACR Flash cache control
  *  Based on  KE1xZP100M72SF0RM
  *
+ *  Frozen - kept as the small RAM image for this family (bug fixes only).
+ *  New operations are added to Kinetis-FTFx-flash-program-gcc only.
+ *  
  * History
  *------------------------------------------------------------------------------------------------
  * 16 May 2021 - Fixed boundary address error in erase block                          | V4.11.1.270
@@ -367,9 +370,9 @@ void programRange(FlashData_t *flashData) {
    }
    // Program words
    while (address < endAddress) {
-      if (address == (NV_FSEC_ADDRESS&~3)) {
-         // Check for permanent secure value
-         if ((*data & (FTFE_FSEC_MEEN_MASK)) == (FTFE_FSEC_MEEN_DISABLE)) {
+      if (address == (NV_FSEC_ADDRESS&~7)) {
+         // Check for permanent secure value (FSEC is byte 4 of the phrase)
+         if ((data[1] & (FTFE_FSEC_MEEN_MASK)) == (FTFE_FSEC_MEEN_DISABLE)) {
             setErrorCode(FLASH_ERR_ILLEGAL_SECURITY);
          }
       }
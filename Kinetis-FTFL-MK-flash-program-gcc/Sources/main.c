@@ -8,6 +8,9 @@
  *  MCM_PLACR Flash cache control
  *  Based on  KE1xZP100M72SF0RM
  *
+ *  Frozen - kept as the small RAM image for this family (bug fixes only).
+ *  New operations are added to Kinetis-FTFx-flash-program-gcc only.
+ *  
  * History
  *------------------------------------------------------------------------------------------------
  * 13 Apr 2017 - Changed address handling                                             | V4.10.6.170 
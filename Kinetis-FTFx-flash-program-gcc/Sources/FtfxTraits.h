@@ -0,0 +1,566 @@
+/**
+ * Family traits for Kinetis FTFx flash programming engine (main.cpp)
+ *
+ *  Each traits class selects at compile time:
+ *  - Phrase size and program command (F_PGM4/F_PGM8)
+ *  - Erase block command (F_ERSALL/F_ERSBLK)
+ *  - FlexNVM support (DFLASH address mapping & partitioning)
+ *  - Watch-dog disable sequence
+ *  - Flash cache control
+ *  - SRAM size (DO_SIZE_BUFFER)
+ *  - Optional operations included in the image
+ *
+ *  The family is chosen by the build configuration e.g.
+ *     -DFTFX_FAMILY=FtfeMkTraits
+ *
+ *  All selections are constants so unused code is discarded by the compiler
+ *  and each image is equivalent to a hand-written routine for that family.
+ *
+ *  FtfxAutoTraits instead selects one of the above families when the routine is
+ *  entered so a single image serves all devices with at least 8K RAM (see end of file).
+ */
+#ifndef FTFX_TRAITS_H
+#define FTFX_TRAITS_H
+
+#include <stdint.h>
+
+// Flash commands
+#define F_RD1BLK                        0x00
+#define F_RD1SEC                        0x01
+#define F_PGMCHK                        0x02
+#define F_RDRSRC                        0x03
+#define F_PGM4                          0x06
+#define F_PGM8                          0x07
+#define F_ERSBLK                        0x08
+#define F_ERSSCR                        0x09
+#define F_PGMSEC                        0x0B
+#define F_RD1ALL                        0x40
+#define F_RDONCE                        0x41
+#define F_PGMONCE                       0x43
+#define F_ERSALL                        0x44
+#define F_VFYKEY                        0x45
+#define F_PGMPART                       0x80UL
+#define F_SETRAM                        0x81
+
+// Optional operations included in image (same bit as CAP_xxx where there is one)
+#define OPT_RESIDENT_AGENT     (1<<0)  // Resident agent entry point (FlashProgramHeader_t.agentEntry)
+#define OPT_FILL_RANGE         (1<<9)  // DO_FILL_RANGE
+#define OPT_RECORD_COUNTERS    (1<<14) // DO_RECORD_COUNTERS
+#define OPT_SCAN_ERRORS        (1<<24) // DO_SCAN_ERRORS
+#define OPT_COPY_RANGE         (1<<25) // DO_COPY_RANGE
+#define OPT_BACKGROUND_VERIFY  (1<<26) // DO_BACKGROUND_VERIFY (needs read-while-write i.e. 2+ blocks)
+#define OPT_SIZE_BUFFER        (1<<28) // DO_SIZE_BUFFER
+
+// Operations included in every fixed family image
+#define OPT_OPERATIONS         (OPT_FILL_RANGE|OPT_RECORD_COUNTERS|OPT_SCAN_ERRORS|OPT_COPY_RANGE|OPT_SIZE_BUFFER)
+
+/*==========================================================================================================
+ * Watch-dog
+ */
+
+/**
+ * Watch-dog with UNLOCK/STCTRLH registers (K, KV, KM devices)
+ *
+ * @tparam base         Address of WDOG
+ * @tparam disabledCtrl Value written to STCTRLH to disable watch-dog
+ */
+template<uint32_t base, uint16_t disabledCtrl>
+struct WdogStctrl_T {
+   static void disable() {
+      volatile uint16_t &unlock  = *(volatile uint16_t *)(base+0x0E);
+      volatile uint16_t &stctrlh = *(volatile uint16_t *)(base+0x00);
+
+      unlock  = 0xC520;
+      unlock  = 0xD928;
+      stctrlh = disabledCtrl;
+   }
+};
+
+/**
+ * Watch-dog with CS register (KE1x devices)
+ *
+ * Must write to all registers to have effect
+ */
+struct WdogCs {
+   static void disable() {
+      volatile uint32_t &cs    = *(volatile uint32_t *)0x40052000;
+      volatile uint32_t &cnt   = *(volatile uint32_t *)0x40052004;
+      volatile uint32_t &toval = *(volatile uint32_t *)0x40052008;
+      volatile uint32_t &win   = *(volatile uint32_t *)0x4005200C;
+
+      cnt   = 0xD928C520;     // Unlock watch-dog
+      toval = 0xFFFFFFFF;
+      win   = 0xFFFFFFFF;
+      cs    = (1<<13)|(1<<11); // CMD32EN|ULK - Disable watch-dog
+   }
+};
+
+/**
+ * COP in SIM (KL devices)
+ */
+struct WdogSimCop {
+   static void disable() {
+      volatile uint32_t &copc = *(volatile uint32_t *)0x40048100;
+
+      copc = 0;
+   }
+};
+
+/*==========================================================================================================
+ * Flash cache control
+ *
+ * disable() is used while a flash command is in progress.
+ * enable() invalidates and re-enables the cache after a flash command.
+ */
+
+/**
+ * FMC with PFB0CR/PFB1CR registers (K devices)
+ */
+struct CacheFmc {
+   static void disable() {
+      *(volatile uint32_t *)0x4001F004 = 0x00000000;
+      *(volatile uint32_t *)0x4001F008 = 0x00000000;
+   }
+   static void enable() {
+      *(volatile uint32_t *)0x4001F004 = 0x1F|(0xFUL<<20)|(1UL<<19); // SEBE|IPE|DPE|ICE|DCE, CINV_WAY|S_B_INV
+      *(volatile uint32_t *)0x4001F008 = 0x1F;
+   }
+};
+
+/**
+ * MCM_PLACR (Cortex-M0+ devices)
+ */
+struct CacheMcm {
+   static void disable() {
+      *(volatile uint32_t *)0xF000300C = (1<<13)|(1<<15); // DFCC|DFCS
+   }
+   static void enable() {
+      *(volatile uint32_t *)0xF000300C = (1<<10);         // CFCC
+   }
+};
+
+/**
+ * LMEM code cache (KE1xF devices)
+ */
+struct CacheLmem {
+   static void disable() {
+      *(volatile uint32_t *)0xE0082000 = 0;
+   }
+   static void enable() {
+      volatile uint32_t &pcccr = *(volatile uint32_t *)0xE0082000;
+
+      pcccr = (1<<24)|(1<<26)|(1UL<<31); // INVW0|INVW1|GO
+      while ((pcccr&(1UL<<31)) != 0) {
+      }
+      pcccr = (1<<0);                    // ENCACHE
+   }
+};
+
+/*==========================================================================================================
+ * SRAM size (DO_SIZE_BUFFER)
+ *
+ * end() returns the end of SRAM_U (exclusive) or 0 if the size is not available from the device.
+ */
+
+/**
+ * RAMSIZE in SIM_SOPT1 (K devices)
+ *
+ * SRAM_U is taken as half of RAM (some larger devices have more).
+ */
+struct RamSimSopt1 {
+   static uint32_t end() {
+      static const uint16_t ramSizes[16] = {0,8,0,16,24,32,48,64,96,128,0,256}; // RAMSIZE => KB
+      uint32_t ramSize = ramSizes[((*(volatile uint32_t *)0x40047000)>>12)&0xF]*1024UL;
+
+      return (ramSize == 0)?0:0x20000000+ramSize/2;
+   }
+};
+
+/**
+ * SRAMSIZE in SIM_SDID (KL, KV1x devices)
+ *
+ * SRAM_U is 3/4 of RAM.
+ */
+struct RamSimSdid {
+   static uint32_t end() {
+      uint32_t sramSize = ((*(volatile uint32_t *)0x40048024)>>16)&0xF;
+
+      return (sramSize > 7)?0:0x20000000+(384UL<<sramSize);
+   }
+};
+
+/**
+ * SRAM size must be supplied by host
+ */
+struct RamUnknown {
+   static uint32_t end() {
+      return 0;
+   }
+};
+
+/*==========================================================================================================
+ * Families
+ *
+ *  phraseSize        Program unit (bytes) - selects F_PGM4/F_PGM8
+ *  eraseBlockCommand F_ERSALL or F_ERSBLK
+ *  hasFlexNvm        DFLASH at 0x10000000 (A23 mapping) and F_PGMPART
+ *  hasFdprot         FDPROT register present
+ *  disableNmi        NMI must be disabled in SIM_CTRL_REG
+ *  flexRamSize       Smallest FlexRAM in family (bytes) - 0 if FlexRAM & F_PGMSEC are not used
+ *  verifyUnit        Unit counted by F_RD1SEC (bytes)
+ *  options           OPT_xxx operations included in image
+ */
+
+/** FTFA - Cortex-M4 (MK) */
+struct FtfaMkTraits {
+   static constexpr unsigned phraseSize        = 4;
+   static constexpr uint32_t eraseBlockCommand = F_ERSALL;
+   static constexpr bool     hasFlexNvm        = false;
+   static constexpr bool     hasFdprot         = true;
+   static constexpr bool     disableNmi        = false;
+   static constexpr uint16_t flexRamSize       = 0;
+   static constexpr uint8_t  verifyUnit        = 4;
+   static constexpr uint32_t options           = OPT_OPERATIONS;
+   typedef WdogStctrl_T<0x40052000, 0xD2>      Watchdog;
+   typedef CacheFmc                            Cache;
+   typedef RamSimSopt1                         Ram;
+};
+
+/** FTFA - Cortex-M0 (MKL) */
+struct FtfaMklTraits {
+   static constexpr unsigned phraseSize        = 4;
+   static constexpr uint32_t eraseBlockCommand = F_ERSALL;
+   static constexpr bool     hasFlexNvm        = false;
+   static constexpr bool     hasFdprot         = true;
+   static constexpr bool     disableNmi        = false;
+   static constexpr uint16_t flexRamSize       = 0;
+   static constexpr uint8_t  verifyUnit        = 4;
+   static constexpr uint32_t options           = OPT_OPERATIONS|OPT_RESIDENT_AGENT;
+   typedef WdogSimCop                          Watchdog;
+   typedef CacheMcm                            Cache;
+   typedef RamSimSdid                          Ram;
+};
+
+/** FTFA - Cortex-M0 (MKM) */
+struct FtfaMkmTraits {
+   static constexpr unsigned phraseSize        = 4;
+   static constexpr uint32_t eraseBlockCommand = F_ERSALL;
+   static constexpr bool     hasFlexNvm        = false;
+   static constexpr bool     hasFdprot         = false;
+   static constexpr bool     disableNmi        = true;
+   static constexpr uint16_t flexRamSize       = 0;
+   static constexpr uint8_t  verifyUnit        = 4;
+   static constexpr uint32_t options           = OPT_OPERATIONS;
+   typedef WdogStctrl_T<0x40053000, 0x0012>    Watchdog;
+   typedef CacheMcm                            Cache;
+   typedef RamUnknown                          Ram;
+};
+
+/** FTFA - Cortex-M0 (MKV10) */
+struct FtfaMkv10Traits {
+   static constexpr unsigned phraseSize        = 4;
+   static constexpr uint32_t eraseBlockCommand = F_ERSALL;
+   static constexpr bool     hasFlexNvm        = false;
+   static constexpr bool     hasFdprot         = false;
+   static constexpr bool     disableNmi        = false;
+   static constexpr uint16_t flexRamSize       = 0;
+   static constexpr uint8_t  verifyUnit        = 4;
+   static constexpr uint32_t options           = OPT_OPERATIONS;
+   typedef WdogStctrl_T<0x40052000, 0xD2>      Watchdog;
+   typedef CacheMcm                            Cache;
+   typedef RamSimSdid                          Ram;
+};
+
+/** FTFE - Cortex-M4 (MK large flash devices) */
+struct FtfeMkTraits {
+   static constexpr unsigned phraseSize        = 8;
+   static constexpr uint32_t eraseBlockCommand = F_ERSBLK;
+   static constexpr bool     hasFlexNvm        = true;
+   static constexpr bool     hasFdprot         = true;
+   static constexpr bool     disableNmi        = false;
+   static constexpr uint16_t flexRamSize       = 4*1024;
+   static constexpr uint8_t  verifyUnit        = 16;
+   static constexpr uint32_t options           = OPT_OPERATIONS|OPT_BACKGROUND_VERIFY;
+   typedef WdogStctrl_T<0x40052000, 0xD2>      Watchdog;
+   typedef CacheFmc                            Cache;
+   typedef RamSimSopt1                         Ram;
+};
+
+/** FTFE - Cortex-M0 (KE1xZ) */
+struct FtfeMkeTraits {
+   static constexpr unsigned phraseSize        = 8;
+   static constexpr uint32_t eraseBlockCommand = F_ERSBLK;
+   static constexpr bool     hasFlexNvm        = true;
+   static constexpr bool     hasFdprot         = true;
+   static constexpr bool     disableNmi        = false;
+   static constexpr uint16_t flexRamSize       = 4*1024;
+   static constexpr uint8_t  verifyUnit        = 16;
+   static constexpr uint32_t options           = OPT_OPERATIONS;
+   typedef WdogCs                              Watchdog;
+   typedef CacheMcm                            Cache;
+   typedef RamUnknown                          Ram;
+};
+
+/** FTFE - Cortex-M4 (KE1xF) */
+struct FtfeMke18Traits {
+   static constexpr unsigned phraseSize        = 8;
+   static constexpr uint32_t eraseBlockCommand = F_ERSBLK;
+   static constexpr bool     hasFlexNvm        = true;
+   static constexpr bool     hasFdprot         = true;
+   static constexpr bool     disableNmi        = false;
+   static constexpr uint16_t flexRamSize       = 4*1024;
+   static constexpr uint8_t  verifyUnit        = 16;
+   static constexpr uint32_t options           = OPT_OPERATIONS;
+   typedef WdogCs                              Watchdog;
+   typedef CacheLmem                           Cache;
+   typedef RamUnknown                          Ram;
+};
+
+/** FTFL - Cortex-M4 (MK) */
+struct FtflMkTraits {
+   static constexpr unsigned phraseSize        = 4;
+   static constexpr uint32_t eraseBlockCommand = F_ERSBLK;
+   static constexpr bool     hasFlexNvm        = true;
+   static constexpr bool     hasFdprot         = true;
+   static constexpr bool     disableNmi        = false;
+   static constexpr uint16_t flexRamSize       = 2*1024;
+   static constexpr uint8_t  verifyUnit        = 8;
+   static constexpr uint32_t options           = OPT_OPERATIONS|OPT_RESIDENT_AGENT|OPT_BACKGROUND_VERIFY;
+   typedef WdogStctrl_T<0x40052000, 0x0012>    Watchdog;
+   typedef CacheFmc                            Cache;
+   typedef RamSimSopt1                         Ram;
+};
+
+/*==========================================================================================================
+ * Family selection
+ */
+
+/**
+ * Family properties that must be known when the image is built
+ *
+ * Fixed families need no selection.  Specialised for FtfxAutoTraits below.
+ */
+template<class Traits>
+struct FamilySelect_T {
+   //! Family properties are only valid after select()
+   static constexpr bool     detected   = false;
+   //! Phrase size reported to host (INFO_PHRASE_SIZE)
+   static constexpr unsigned phraseSize = Traits::phraseSize;
+   //! FlexNVM partitioning reported to host (CAP_PARTITION_FLEXNVM)
+   static constexpr bool     hasFlexNvm = Traits::hasFlexNvm;
+   //! FlexRAM buffer reported to host (CAP_FLEXRAM_BUFFER)
+   static constexpr bool     hasFlexRam = Traits::flexRamSize != 0;
+
+   static bool select(uint32_t) {
+      return true;
+   }
+};
+
+/*==========================================================================================================
+ * Family detected at run-time
+ *
+ *  One image serves all the families above.  On entry the family is chosen from
+ *  FlashData_t.familyHint (FTFX_HINT_xxx) or, if that is FTFX_HINT_DETECT, from:
+ *  - Core (CPUID)           Cortex-M0+ or Cortex-M4
+ *  - Flash controller       Read 1s Section alignment (FTFA longword, FTFL phrase, FTFE 128-bit)
+ *  - SIM_SDID.SERIESID      KL or KV (Cortex-M0+ FTFA)
+ *  Cortex-M4 FTFE devices (MK or KE1xF) and KM devices cannot be told apart this way
+ *  and require a hint.
+ *
+ *  The properties of the chosen family are copied from a small table built from the
+ *  traits above so the engine code is shared.  The image reports an 8-byte phrase and
+ *  FlexNVM partitioning so the host's data suits every family.
+ *  Only the basic operations are included (options = 0) to keep the image small - it still
+ *  needs more RAM than the per-family images (see FtfxAuto_flash.ld).
+ *  Build for Cortex-M0+ (runs on both cores).
+ */
+
+// FlashData_t.familyHint values
+#define FTFX_HINT_DETECT       (0) // Detect family
+#define FTFX_HINT_FTFA_MK      (1) // FtfaMkTraits
+#define FTFX_HINT_FTFA_MKL     (2) // FtfaMklTraits
+#define FTFX_HINT_FTFA_MKM     (3) // FtfaMkmTraits
+#define FTFX_HINT_FTFA_MKV10   (4) // FtfaMkv10Traits
+#define FTFX_HINT_FTFE_MK      (5) // FtfeMkTraits
+#define FTFX_HINT_FTFE_MKE     (6) // FtfeMkeTraits
+#define FTFX_HINT_FTFE_MKE18   (7) // FtfeMke18Traits
+#define FTFX_HINT_FTFL_MK      (8) // FtflMkTraits
+
+/** Entry in family dispatch table */
+struct FtfxFamilyEntry {
+   uint8_t  phraseSize;
+   uint8_t  eraseBlockCommand;
+   bool     hasFlexNvm;
+   bool     hasFdprot;
+   bool     disableNmi;
+   uint16_t flexRamSize;
+   uint8_t  verifyUnit;
+   void   (*disableWatchdog)();
+   void   (*disableCache)();
+   void   (*enableCache)();
+   uint32_t (*ramEnd)();
+};
+
+/**
+ * Create dispatch table entry for family
+ *
+ * @tparam Traits Family traits
+ */
+template<class Traits>
+constexpr FtfxFamilyEntry ftfxFamilyEntry() {
+   return {Traits::phraseSize, Traits::eraseBlockCommand, Traits::hasFlexNvm, Traits::hasFdprot, Traits::disableNmi,
+           Traits::flexRamSize, Traits::verifyUnit,
+           Traits::Watchdog::disable, Traits::Cache::disable, Traits::Cache::enable,
+           Traits::Ram::end};
+}
+
+/** Dispatch table (index is FTFX_HINT_xxx-1) */
+static const FtfxFamilyEntry ftfxFamilies[] = {
+   ftfxFamilyEntry<FtfaMkTraits>(),
+   ftfxFamilyEntry<FtfaMklTraits>(),
+   ftfxFamilyEntry<FtfaMkmTraits>(),
+   ftfxFamilyEntry<FtfaMkv10Traits>(),
+   ftfxFamilyEntry<FtfeMkTraits>(),
+   ftfxFamilyEntry<FtfeMkeTraits>(),
+   ftfxFamilyEntry<FtfeMke18Traits>(),
+   ftfxFamilyEntry<FtflMkTraits>(),
+};
+
+/**
+ * Run-time family
+ *
+ * Properties are variables set by select() (a template so they may be defined here).
+ */
+template<int unused=0>
+struct FtfxAutoTraits_T {
+   static unsigned               phraseSize;
+   static uint32_t               eraseBlockCommand;
+   static bool                   hasFlexNvm;
+   static bool                   hasFdprot;
+   static bool                   disableNmi;
+   static uint16_t               flexRamSize;
+   static uint8_t                verifyUnit;
+   static constexpr uint32_t     options = 0;
+   static const FtfxFamilyEntry *family;
+
+   struct Watchdog {
+      static void disable() {
+         family->disableWatchdog();
+      }
+   };
+   struct Cache {
+      static void disable() {
+         family->disableCache();
+      }
+      static void enable() {
+         family->enableCache();
+      }
+   };
+   struct Ram {
+      static uint32_t end() {
+         return family->ramEnd();
+      }
+   };
+
+   /**
+    * Check if Read 1s Section of one unit is rejected at an address
+    *
+    * Read 1s Section requires an address aligned to the unit it counts (FTFA longword,
+    * FTFL phrase, FTFE 128-bit) and reports ACCERR otherwise.
+    * Address 8 is only rejected by FTFE, address 4 by FTFL and FTFE.
+    * Nothing is changed in the flash.
+    *
+    * @param address Flash address to probe
+    */
+   static bool rd1secRejected(uint32_t address) {
+      volatile uint8_t  &fstat    = *(volatile uint8_t  *)0x40020000;
+      volatile uint32_t &fccob0_3 = *(volatile uint32_t *)0x40020004;
+      volatile uint32_t &fccob4_7 = *(volatile uint32_t *)0x40020008;
+
+      fstat    = 0x30;                  // Clear ACCERR|FPVIOL
+      fccob0_3 = (F_RD1SEC<<24)|address;
+      fccob4_7 = (1<<16);               // 1 unit, normal margin
+      fstat    = 0x80;                  // Launch command (CCIF)
+      while ((fstat&0x80) == 0) {
+      }
+      bool rejected = (fstat&0x20) != 0;
+      fstat    = 0x30;
+      return rejected;
+   }
+
+   /**
+    * Identify family from device
+    *
+    * @return FTFX_HINT_xxx (FTFX_HINT_DETECT if unknown)
+    */
+   static unsigned detect() {
+      uint32_t cpuid  = *(volatile uint32_t *)0xE000ED00;
+      bool     m0plus = ((cpuid>>4)&0xFFF) == 0xC60;
+
+      if (rd1secRejected(8)) {
+         // FTFE - MK and KE1xF are both Cortex-M4
+         return m0plus?FTFX_HINT_FTFE_MKE:FTFX_HINT_DETECT;
+      }
+      if (!m0plus) {
+         // FTFL whether or not FlexNVM is fitted
+         return rd1secRejected(4)?FTFX_HINT_FTFL_MK:FTFX_HINT_FTFA_MK;
+      }
+      uint32_t sdid = *(volatile uint32_t *)0x40048024;
+      switch ((sdid>>20)&0xF) {
+      case 1  : return FTFX_HINT_FTFA_MKL;
+      case 6  : return FTFX_HINT_FTFA_MKV10;
+      default : return FTFX_HINT_DETECT;
+      }
+   }
+
+   /**
+    * Select family
+    *
+    * @param hint FTFX_HINT_xxx
+    *
+    * @return false if the family is unknown
+    */
+   static bool select(uint32_t hint) {
+      if (hint == FTFX_HINT_DETECT) {
+         hint = detect();
+      }
+      if ((hint == FTFX_HINT_DETECT) || (hint > sizeof(ftfxFamilies)/sizeof(ftfxFamilies[0]))) {
+         return false;
+      }
+      family            = &ftfxFamilies[hint-1];
+      phraseSize        = family->phraseSize;
+      eraseBlockCommand = family->eraseBlockCommand;
+      hasFlexNvm        = family->hasFlexNvm;
+      hasFdprot         = family->hasFdprot;
+      disableNmi        = family->disableNmi;
+      flexRamSize       = family->flexRamSize;
+      verifyUnit        = family->verifyUnit;
+      return true;
+   }
+};
+
+template<int unused> unsigned               FtfxAutoTraits_T<unused>::phraseSize;
+template<int unused> uint32_t               FtfxAutoTraits_T<unused>::eraseBlockCommand;
+template<int unused> bool                   FtfxAutoTraits_T<unused>::hasFlexNvm;
+template<int unused> bool                   FtfxAutoTraits_T<unused>::hasFdprot;
+template<int unused> bool                   FtfxAutoTraits_T<unused>::disableNmi;
+template<int unused> uint16_t               FtfxAutoTraits_T<unused>::flexRamSize;
+template<int unused> uint8_t                FtfxAutoTraits_T<unused>::verifyUnit;
+template<int unused> const FtfxFamilyEntry *FtfxAutoTraits_T<unused>::family;
+
+/** Family detected at run-time */
+typedef FtfxAutoTraits_T<> FtfxAutoTraits;
+
+template<>
+struct FamilySelect_T<FtfxAutoTraits> {
+   static constexpr bool     detected   = true;
+   static constexpr unsigned phraseSize = 8;
+   static constexpr bool     hasFlexNvm = true;
+   static constexpr bool     hasFlexRam = true;
+
+   static bool select(uint32_t hint) {
+      return FtfxAutoTraits::select(hint);
+   }
+};
+
+#endif // FTFX_TRAITS_H
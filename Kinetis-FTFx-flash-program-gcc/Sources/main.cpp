@@ -0,0 +1,1515 @@
+/**
+ * Flash code for Kinetis FTFA/FTFE/FTFL memory (single source for all families)
+ *
+ *  Summary
+ *  MPU       Cortex-M0/M4
+ *  FTFx      Controller
+ *  WDOG      Watch-dog timer (selected by family traits)
+ *  Cache     Flash cache control (selected by family traits)
+ *
+ *  The family is selected by defining FTFX_FAMILY as one of the traits classes in
+ *  FtfxTraits.h e.g. -DFTFX_FAMILY=FtfaMklTraits
+ *  or -DFTFX_FAMILY=FtfxAutoTraits for a single image that selects the family at run-time
+ *
+ *  Build with arm-none-eabi-g++ -Os -fno-exceptions -fno-rtti -fno-threadsafe-statics
+ *  There is no C++ run-time start-up so all static objects must be constant initialised.
+ */
+#include <stdint.h>
+#include "FtfxTraits.h"
+
+#ifndef FTFX_FAMILY
+#error "FTFX_FAMILY must be defined e.g. -DFTFX_FAMILY=FtfeMkTraits"
+#endif
+
+typedef FTFX_FAMILY Family;
+typedef FamilySelect_T<Family> FamilySelect;
+
+#ifndef NULL
+#define NULL ((void*)0)
+#endif
+
+// Enable for debugging
+//#define DEBUG
+
+//==========================================================================================================
+// Target defines
+
+// Vector Table Offset Register
+#define SCB_VTOR (*(volatile uint32_t *)0xE000ED08)
+
+// System Control Register - SEVONPEND lets a pending (even if disabled) interrupt wake WFE
+#define SCB_SCR           (*(volatile uint32_t *)0xE000ED10)
+#define SCB_SCR_SEVONPEND (1<<4)
+
+// Interrupt Set/Clear-Pending Registers (flash IRQ is never taken - only used as a wake-up event)
+#define NVIC_ISPR0        (*(volatile uint32_t *)0xE000E200)
+#define NVIC_ICPR0        (*(volatile uint32_t *)0xE000E280)
+
+//! NVIC pending bit of flash command complete IRQ (0 if not found - waitForCommand() polls)
+static uint32_t flashIrqMask;
+
+// NMI disable (only used if Family::disableNmi)
+#define SIM_CTRL_REG                    (*(volatile uint32_t*) 0x4003F004)
+#define SIM_CTRL_REG_NMIDIS             (1<<1)
+
+#define NV_SECURITY_ADDRESS            (0x00000400)
+#define NV_FSEC_ADDRESS                (NV_SECURITY_ADDRESS+0x0C)
+#define FTFX_FSEC_KEY_MASK              0xC0
+#define FTFX_FSEC_KEY_ENABLE            0x80
+#define FTFX_FSEC_KEY_DISABLE           0xC0
+#define FTFX_FSEC_MEEN_MASK             0x30
+#define FTFX_FSEC_MEEN_ENABLE           0x30
+#define FTFX_FSEC_MEEN_DISABLE          0x20
+#define FTFX_FSEC_FSLACC                0x0C
+#define FTFX_FSEC_SEC_MASK              0x03
+#define FTFX_FSEC_UNSEC                 0x02
+#define FTFX_FSEC_SEC                   0x03
+
+#ifdef DEBUG
+#define FTFX_BASE_ADDRESS               ((volatile FlashController *)0x40020000)
+#endif
+
+#pragma pack(1)
+typedef struct {
+   uint8_t  fstat;
+   uint8_t  fcnfg;
+   uint8_t  fsec;
+   uint8_t  fopt;
+   uint32_t fccob0_3;
+   uint32_t fccob4_7;
+   uint32_t fccob8_B;
+   uint32_t fprot0_3;
+   uint8_t  feprot;     // Only if Family::hasFdprot
+   uint8_t  fdprot;     // Only if Family::hasFdprot
+} FlashController;
+
+#pragma pack(0)
+
+#define FTFX_FSTAT_CCIF                 0x80
+#define FTFX_FSTAT_RDCOLLERR            0x40
+#define FTFX_FSTAT_ACCERR               0x20
+#define FTFX_FSTAT_FPVIOL               0x10
+#define FTFX_FSTAT_MGSTAT0              0x01
+
+#define FTFX_FCNFG_CCIE                 0x80
+#define FTFX_FCNFG_RDCOLLIE             0x40
+#define FTFX_FCNFG_ERSAREQ              0x20
+#define FTFX_FCNFG_ERSSUSP              0x10
+#define FTFX_FCNFG_SWAP                 0x08
+#define FTFX_FCNFG_PFLSH                0x04
+#define FTFX_FCNFG_RAMRDY               0x02
+#define FTFX_FCNFG_EEERDY               0x01
+
+#define F_USER_MARGIN                   0x01 // Use 'user' margin on flash verify
+#define F_FACTORY_MARGIN                0x02 // Use 'factory' margin on flash verify
+
+/*==========================================================================================================
+ * Operation masks
+ *
+ *  The following combinations (amongst others) are sensible:
+ *  DO_PROGRAM_RANGE|DO_VERIFY_RANGE program & verify range assuming previously erased
+ *  DO_ERASE_RANGE|DO_BLANK_CHECK_RANGE|DO_PROGRAM_RANGE|DO_VERIFY_RANGE do all steps
+ */
+#define DO_INIT_FLASH         (1<<0) // Do initialisation of flash
+#define DO_ERASE_BLOCK        (1<<1) // Erase entire flash block e.g. Flash, FlexNVM etc
+#define DO_ERASE_RANGE        (1<<2) // Erase range (including option region)
+#define DO_BLANK_CHECK_RANGE  (1<<3) // Blank check region
+#define DO_PROGRAM_RANGE      (1<<4) // Program range (including option region)
+#define DO_VERIFY_RANGE       (1<<5) // Verify range
+#define DO_PARTITION_FLEXNVM  (1<<7) // Program FlexNVM DFLASH/EEPROM partitioning
+#define DO_TIMING_LOOP        (1<<8) // Counting loop to determine clock speed
+#define DO_FILL_RANGE         (1<<11) // Program range with FlashData_t.fillPattern (no data transferred)
+#define DO_RECORD_COUNTERS    (1<<14) // Record performance counters in FlashData_t
+#define DO_SCAN_ERRORS        (1<<24) // Record verify/blank check failures in failMap and continue
+#define DO_COPY_RANGE         (1<<25) // Program range from FlashData_t.dataAddress in flash (copy on target)
+#define DO_BACKGROUND_VERIFY  (1<<26) // Verify background range while erasing (read-while-write)
+#define DO_SIZE_BUFFER        (1<<27) // Report largest free RAM region after image in dataAddress/dataSize
+#define DO_FLEXRAM_BUFFER     (1<<28) // Report FlexRAM (if available as RAM) in dataAddress/dataSize
+
+#define IS_COMPLETE           (1<<31)
+
+// Capability masks
+#define CAP_RESIDENT_AGENT     (1<<0)
+#define CAP_ERASE_BLOCK        (1<<1)
+#define CAP_ERASE_RANGE        (1<<2)
+#define CAP_BLANK_CHECK_RANGE  (1<<3)
+#define CAP_PROGRAM_RANGE      (1<<4)
+#define CAP_VERIFY_RANGE       (1<<5)
+#define CAP_UNLOCK_FLASH       (1<<6)
+#define CAP_PARTITION_FLEXNVM  (1<<7)
+#define CAP_TIMING             (1<<8)
+#define CAP_FILL_RANGE         (1<<9)
+#define CAP_RECORD_COUNTERS    (1<<14)
+#define CAP_SCAN_ERRORS        (1<<24)
+#define CAP_COPY_RANGE         (1<<25)
+#define CAP_BACKGROUND_VERIFY  (1<<26)
+#define CAP_SIZE_BUFFER        (1<<28)
+#define CAP_FLEXRAM_BUFFER     (1<<29)
+
+#define CAP_HEADER_V2          (1<<10) // Indicates FlashProgramHeader_t.info is valid
+#define CAP_DSC_OVERLAY        (1<<11) // Indicates DSC code in pMEM overlays xRAM
+#define CAP_DATA_FIXED         (1<<12) // Indicates TargetFlashDataHeader is at fixed address
+#define CAP_SELF_CHECK         (1<<27) // Indicates FlashProgramHeader_t.selfCheck is valid
+
+#define CAP_RELOCATABLE        (1<<31)
+
+#define ADDRESS_LINEAR (1UL<<31) // Indicate address is linear
+#define ADDRESS_EEPROM (1UL<<30) // Indicate address lies within EEPROM
+
+// These error numbers are just for debugging
+typedef enum {
+     FLASH_ERR_OK                = (0),
+     FLASH_ERR_LOCKED            = (1),  // Flash is still locked
+     FLASH_ERR_ILLEGAL_PARAMS    = (2),  // Parameters illegal
+     FLASH_ERR_PROG_FAILED       = (3),  // STM - Programming operation failed - general
+     FLASH_ERR_PROG_WPROT        = (4),  // STM - Programming operation failed - write protected
+     FLASH_ERR_VERIFY_FAILED     = (5),  // Verify failed
+     FLASH_ERR_ERASE_FAILED      = (6),  // Erase or Blank Check failed
+     FLASH_ERR_TRAP              = (7),  // Program trapped (illegal instruction/location etc.)
+     FLASH_ERR_PROG_ACCERR       = (8),  // Kinetis/CFVx - Programming operation failed - ACCERR
+     FLASH_ERR_PROG_FPVIOL       = (9),  // Kinetis/CFVx - Programming operation failed - FPVIOL
+     FLASH_ERR_PROG_MGSTAT0      = (10), // Kinetis - Programming operation failed - MGSTAT0
+     FLASH_ERR_CLKDIV            = (11), // CFVx - Clock divider not set
+     FLASH_ERR_ILLEGAL_SECURITY  = (12), // Kinetis/CFV1+ - Illegal value for security location
+     FLASH_ERR_UNKNOWN           = (13)  // Unspecified error
+} FlashDriverError_t;
+
+// Number of words verified between checks for erase complete (DO_BACKGROUND_VERIFY)
+#define BACKGROUND_VERIFY_CHUNK (8)
+
+// This is the smallest unit of Flash that can be erased
+#define FLASH_SECTOR_SIZE  (1*(1<<10)) // 1K block size (used for stride in erase)
+
+// Size of buffer programmed repeatedly by fillRange() (DO_FILL_RANGE)
+#define FILL_CHUNK_SIZE (32)
+
+// Size of buffer used to stage data by copyRange() (DO_COPY_RANGE)
+#define COPY_CHUNK_SIZE (32)
+
+// FlexRAM - available as RAM when not used for EEPROM (FCNFG.RAMRDY)
+#define FLEXRAM_ADDRESS (0x14000000)
+
+typedef void (*EntryPoint_t)(void);
+
+/** Performance counters (only written if DO_RECORD_COUNTERS) */
+typedef struct {
+   uint32_t eraseTicks;       // Ticks spent erasing (block, partition & range)
+   uint32_t blankCheckTicks;  // Ticks spent blank checking
+   uint32_t programTicks;     // Ticks spent programming
+   uint32_t verifyTicks;      // Ticks spent verifying
+   uint32_t programSkipped;   // Program commands skipped as data was all erased value
+} FlashCounters_t;
+#pragma pack(2)
+// Describes a block to be programmed & result
+// The layout is the same for all families - background fields are unused if !CAP_BACKGROUND_VERIFY
+typedef struct {
+   uint32_t                  flags;             // Controls actions of routine
+   volatile FlashController *controller;        // Pointer to flash controller
+   uint32_t                  frequency;         // Target frequency (kHz)
+   uint16_t                  errorCode;         // Error code from action
+   uint16_t                  sectorSize;        // Size of flash sectors (minimum erase size)
+   uint32_t                  address;           // Memory address being accessed
+   uint32_t                  dataSize;          // Size of memory range being accessed
+   const uint32_t           *dataAddress;       // Pointer to data to program
+   FlashCounters_t           counters;          // Performance counters (only if DO_RECORD_COUNTERS)
+   uint32_t                  backgroundAddress; // Range to verify while erasing (only if DO_BACKGROUND_VERIFY)
+   uint32_t                  backgroundSize;    //   Size of range (bytes)
+   const uint32_t           *backgroundData;    //   Pointer to data to verify against
+   uint32_t                 *failMap;           // Bitmap of failing sectors in range (only if DO_SCAN_ERRORS)
+   uint32_t                  failCount;         //   Number of failing sectors
+   uint32_t                  firstFailAddress;  //   First failing address
+   uint32_t                  lastFailAddress;   //   Last failing address
+   uint32_t                  fillPattern[2];    // Pattern repeated over range (only if DO_FILL_RANGE)
+   uint32_t                  familyHint;        // FTFX_HINT_xxx (only if FtfxAutoTraits image)
+} FlashData_t;
+
+/*==========================================================================================================
+ * Information records (CAP_HEADER_V2)
+ *
+ * FlashProgramHeader_t.info points to a list of tag/length/value records terminated by INFO_END.
+ * Values are in target byte order.  Records with unknown tags should be skipped using length.
+ */
+#define HEADER_VERSION       (2)
+
+#define INFO_END             (0) // End of list
+#define INFO_VERSION         (1) // Header version (HEADER_VERSION)
+#define INFO_PHRASE_SIZE     (2) // Minimum program unit (bytes)
+#define INFO_SECTOR_SIZE     (3) // Minimum erase unit (bytes)
+#define INFO_BUFFER_ADDRESS  (4) // First free location after image (suitable for data buffer)
+#define INFO_BUFFER_SIZE     (5) // Largest dataSize accepted by a single call (bytes)
+#define INFO_OPERATIONS      (6) // Supported operations (CAP_xxx mask)
+#define INFO_CLOCK           (7) // Clock requirement (INFO_CLOCK_xxx or assumed bus clock in kHz)
+#define INFO_ENDIAN          (8) // Byte order (INFO_ENDIAN_xxx)
+#define INFO_ADDRESS_UNIT    (9) // Size of addressable unit (bytes)
+#define INFO_CHECK_START     (10) // Start of range covered by FlashProgramHeader_t.buildHash
+#define INFO_CHECK_END       (11) // End of range covered by FlashProgramHeader_t.buildHash
+
+#define INFO_CLOCK_NONE      (0)            // Flash controller needs no clock set-up
+#define INFO_CLOCK_FREQUENCY (0xFFFFFFFFUL) // Flash clock divider is calculated from flashData->frequency
+#define INFO_CLOCK_HOST      (0xFFFFFFFEUL) // Flash clock divider must be set by host
+
+#define INFO_ENDIAN_LITTLE   (0)
+#define INFO_ENDIAN_BIG      (1)
+
+/** Information record */
+typedef struct {
+   uint16_t         tag;               // Type of record (INFO_xxx)
+   uint16_t         length;            // Size of value (bytes)
+   uint32_t         value;             // Value
+} FlashInfoRecord_t;
+
+//! Describe the flash programming code
+typedef struct {
+   uint32_t        *loadAddress;       // Address where to load this image
+   EntryPoint_t     entry;             // Pointer to entry routine
+   uint32_t         capabilities;      // Capabilities of routine
+   EntryPoint_t     agentEntry;        // Pointer to resident agent entry routine (NULL if none)
+   const FlashInfoRecord_t *info;      // Pointer to information records (CAP_HEADER_V2)
+   FlashData_t     *flashData;         // Pointer to information about operation
+   uint32_t         buildHash;         // CRC-32 of image [INFO_CHECK_START,INFO_CHECK_END) - set by host (CAP_SELF_CHECK)
+   EntryPoint_t     selfCheck;         // Pointer to self-check routine (CAP_SELF_CHECK)
+} FlashProgramHeader_t;
+
+#pragma pack(0)
+
+extern "C" {
+extern uint32_t __loadAddress[];
+extern uint32_t __dataBuffer[];
+extern uint32_t __dataBufferSize[];
+extern uint32_t __checkStart[];
+extern uint32_t __checkEnd[];
+
+//! Minimal vector table
+extern uint32_t __vector_table[];
+
+//! Some stack space
+extern uint32_t __stacktop[];
+
+extern volatile const FlashProgramHeader_t gFlashProgramHeader;
+
+void asm_entry(void);
+void asm_agentEntry(void);
+void asm_selfCheck(void);
+void asm_testApp(void);
+void entry(void);
+void agentEntry(void) __attribute__ ((noreturn));
+void agentLoop(void) __attribute__ ((noreturn));
+void selfCheck(void) __attribute__ ((noreturn));
+void isr_default(void);
+void testApp(void);
+}
+
+#define CAPABILITIES (CAP_BLANK_CHECK_RANGE|CAP_ERASE_RANGE|CAP_ERASE_BLOCK|CAP_PROGRAM_RANGE|\
+                      CAP_VERIFY_RANGE|CAP_HEADER_V2|CAP_SELF_CHECK|CAP_DATA_FIXED|\
+                      (Family::options&OPT_OPERATIONS)|\
+                      (FamilySelect::hasFlexNvm?CAP_PARTITION_FLEXNVM:0)|\
+                      (FamilySelect::hasFlexRam?CAP_FLEXRAM_BUFFER:0)|\
+                      (Family::options&OPT_BACKGROUND_VERIFY?CAP_BACKGROUND_VERIFY:0)|\
+                      (Family::options&OPT_RESIDENT_AGENT?CAP_RESIDENT_AGENT:0))
+
+/**
+ * Fixed location of FlashData_t (CAP_DATA_FIXED) - not part of loaded image
+ */
+FlashData_t gFlashData __attribute__((section(".flashData")));
+
+/**
+ * Information records describing this routine
+ */
+const FlashInfoRecord_t flashInfo[] = {
+     {INFO_VERSION,        4, HEADER_VERSION},
+     {INFO_PHRASE_SIZE,    4, FamilySelect::phraseSize},
+     {INFO_BUFFER_ADDRESS, 4, (uint32_t)__dataBuffer},
+     {INFO_BUFFER_SIZE,    4, (uint32_t)__dataBufferSize},
+     {INFO_OPERATIONS,     4, CAPABILITIES},
+     {INFO_CLOCK,          4, INFO_CLOCK_NONE},
+     {INFO_ENDIAN,         4, INFO_ENDIAN_LITTLE},
+     {INFO_ADDRESS_UNIT,   4, 1},
+     {INFO_CHECK_START,    4, (uint32_t)__checkStart},
+     {INFO_CHECK_END,      4, (uint32_t)__checkEnd},
+     {INFO_END,            0, 0},
+};
+
+/**
+ * Flash programming command table
+ */
+volatile const FlashProgramHeader_t gFlashProgramHeader = {
+     /* loadAddress  */ __loadAddress,     // load address of image
+     /* entry        */ asm_entry,         // entry point for code
+     /* capabilities */ CAPABILITIES,
+     /* agentEntry   */ (Family::options&OPT_RESIDENT_AGENT)?asm_agentEntry:0, // entry point for resident agent
+     /* info         */ flashInfo,
+     /* flashData    */ &gFlashData,       // fixed location (CAP_DATA_FIXED)
+     /* buildHash    */ 0,                 // set by host when image is loaded
+     /* selfCheck    */ asm_selfCheck,     // self-check entry point
+};
+
+void setErrorCode(int errorCode) __attribute__ ((noreturn));
+
+/**
+ * Default unexpected interrupt handler
+ */
+void isr_default(void) {
+   setErrorCode(FLASH_ERR_TRAP);
+}
+
+/*==========================================================================================================
+ * Performance counters (DO_RECORD_COUNTERS)
+ *
+ * Ticks are core clock cycles:
+ *   Cortex-M3/M4 - DWT cycle counter
+ *   Cortex-M0    - SysTick extended to 32-bits in software
+ */
+#if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__)
+#define USE_DWT_CYCCNT
+#endif
+
+#if defined(USE_DWT_CYCCNT)
+#define DEMCR                 (*(volatile uint32_t *)0xE000EDFC)
+#define DEMCR_TRCENA          (1<<24)
+#define DWT_CTRL              (*(volatile uint32_t *)0xE0001000)
+#define DWT_CTRL_CYCCNTENA    (1<<0)
+#define DWT_CYCCNT            (*(volatile uint32_t *)0xE0001004)
+#else
+#define SYST_CSR              (*(volatile uint32_t *)0xE000E010)
+#define SYST_RVR              (*(volatile uint32_t *)0xE000E014)
+#define SYST_CVR              (*(volatile uint32_t *)0xE000E018)
+#define SYST_CSR_ENABLE       (1<<0)
+#define SYST_CSR_CLKSOURCE    (1<<2)
+#define SYST_MAX_COUNT        (0x00FFFFFF)
+
+//! SysTick value when last sampled
+static uint32_t lastSysTick;
+//! Extended tick count
+static uint32_t tickCount;
+#endif
+
+//! Counter for phase in progress (NULL if none)
+static uint32_t *phaseCounter;
+//! Tick count at start of phase in progress
+static uint32_t  phaseStart;
+
+/**
+ * Get current tick count
+ *
+ * @note On Cortex-M0 this must be called at least every 2^24 cycles
+ */
+static uint32_t getTicks(void) {
+#if defined(USE_DWT_CYCCNT)
+   return DWT_CYCCNT;
+#else
+   uint32_t now = SYST_CVR;
+   // SysTick counts down
+   tickCount   += (lastSysTick-now)&SYST_MAX_COUNT;
+   lastSysTick  = now;
+   return tickCount;
+#endif
+}
+
+/**
+ * Clear counters and start tick source if DO_RECORD_COUNTERS
+ */
+static void initCounters(FlashData_t *flashData) {
+   phaseCounter = 0;
+   if (!(Family::options&OPT_RECORD_COUNTERS) || ((flashData->flags&DO_RECORD_COUNTERS) == 0)) {
+      return;
+   }
+   flashData->counters.eraseTicks      = 0;
+   flashData->counters.blankCheckTicks = 0;
+   flashData->counters.programTicks    = 0;
+   flashData->counters.verifyTicks     = 0;
+   flashData->counters.programSkipped  = 0;
+#if defined(USE_DWT_CYCCNT)
+   DEMCR      |= DEMCR_TRCENA;
+   DWT_CTRL   |= DWT_CTRL_CYCCNTENA;
+#else
+   SYST_CSR    = 0;
+   SYST_RVR    = SYST_MAX_COUNT;
+   SYST_CVR    = 0;
+   SYST_CSR    = SYST_CSR_CLKSOURCE|SYST_CSR_ENABLE;
+   lastSysTick = SYST_CVR;
+   tickCount   = 0;
+#endif
+}
+
+/**
+ * Accumulate ticks for phase in progress and start a new phase
+ *
+ * @param flashData Pointer to flash programming information
+ * @param counter   Counter for new phase (NULL to just end phase in progress)
+ */
+static void startPhase(FlashData_t *flashData, uint32_t *counter) {
+   uint32_t now;
+   if (!(Family::options&OPT_RECORD_COUNTERS) || ((flashData->flags&DO_RECORD_COUNTERS) == 0)) {
+      return;
+   }
+   now = getTicks();
+   if (phaseCounter != 0) {
+      *phaseCounter += now-phaseStart;
+   }
+   phaseCounter = counter;
+   phaseStart   = now;
+}
+
+/** Set when running as a resident agent (see agentEntry()) */
+static volatile int agentMode;
+
+/**
+ * Set error code to return to BDM & halt
+ */
+void setErrorCode(int errorCode) {
+   FlashData_t *flashData = gFlashProgramHeader.flashData;
+   startPhase(flashData, 0);
+   flashData->errorCode   = (uint16_t)errorCode;
+   flashData->flags      |= IS_COMPLETE;
+   if ((Family::options&OPT_RESIDENT_AGENT) && agentMode) {
+      // Discard current call chain and wait for next request
+      __asm__ volatile (
+      "mov   sp,%[stacktop]\n\t"
+      "b     agentLoop\n\t"::[stacktop] "r" (__stacktop));
+   }
+   for(;;) {
+      __asm__("bkpt  0");
+   }
+}
+
+/*==========================================================================================================
+ * Continue-on-error scan (DO_SCAN_ERRORS)
+ *
+ * Verify and blank check failures are recorded in the host supplied bitmap (bit n => n-th
+ * sector spanned by the range) and checking continues.  The first error is reported once all
+ * operations are complete.
+ */
+//! log2(sectorSize)
+static uint32_t sectorShift;
+//! Error code of first failure recorded
+static int      scanErrorCode;
+
+/**
+ * Initialise scan results (DO_SCAN_ERRORS)
+ *
+ * @param flashData Pointer to flash programming information
+ */
+static void initScan(FlashData_t *flashData) {
+   uint32_t numWords;
+
+   if (!(Family::options&OPT_SCAN_ERRORS) || ((flashData->flags&DO_SCAN_ERRORS) == 0)) {
+      return;
+   }
+   scanErrorCode               = FLASH_ERR_OK;
+   flashData->failCount        = 0;
+   flashData->firstFailAddress = 0;
+   flashData->lastFailAddress  = 0;
+   sectorShift = 0;
+   while ((1UL<<sectorShift) < flashData->sectorSize) {
+      sectorShift++;
+   }
+   if (flashData->dataSize == 0) {
+      return;
+   }
+   // Clear bitmap for sectors spanned by range
+   numWords = ((((flashData->address&(flashData->sectorSize-1U))+flashData->dataSize-1)>>sectorShift)+32)/32;
+   while (numWords-- > 0) {
+      flashData->failMap[numWords] = 0;
+   }
+}
+
+/**
+ * Record a verify or blank check failure
+ *
+ * Without DO_SCAN_ERRORS the error is reported immediately (does not return)
+ *
+ * @param flashData Pointer to flash programming information
+ * @param offset    Offset of failing location from start of range
+ * @param errorCode Error to report
+ */
+static void recordFailure(FlashData_t *flashData, uint32_t offset, int errorCode) {
+   uint32_t sector;
+   uint32_t mask;
+
+   if (!(Family::options&OPT_SCAN_ERRORS) || ((flashData->flags&DO_SCAN_ERRORS) == 0)) {
+      setErrorCode(errorCode);
+   }
+   sector = ((flashData->address&(flashData->sectorSize-1U))+offset)>>sectorShift;
+   mask   = 1UL<<(sector%32);
+   if ((flashData->failMap[sector/32]&mask) == 0) {
+      flashData->failMap[sector/32] |= mask;
+      flashData->failCount++;
+   }
+   if (scanErrorCode == FLASH_ERR_OK) {
+      scanErrorCode               = errorCode;
+      flashData->firstFailAddress = flashData->address+offset;
+   }
+   flashData->lastFailAddress = flashData->address+offset;
+}
+
+/**
+ * Report first failure recorded by scan (DO_SCAN_ERRORS)
+ *
+ * @param flashData Pointer to flash programming information
+ */
+static void reportScanErrors(FlashData_t *flashData) {
+   if (!(Family::options&OPT_SCAN_ERRORS) || ((flashData->flags&DO_SCAN_ERRORS) == 0)) {
+      return;
+   }
+   flashData->flags &= ~DO_SCAN_ERRORS;
+   if (scanErrorCode != FLASH_ERR_OK) {
+      setErrorCode(scanErrorCode);
+   }
+}
+
+/*==========================================================================================================
+ * Block compare kernels
+ *
+ * These scan flash a block of words at a time using LDM and reduce each block to a single
+ * test-and-branch.  They only locate the first failing block - the caller re-scans from
+ * there a word at a time to find the failing location and to handle any partial block.
+ *
+ *   Cortex-M3/M4 - 8 words per block
+ *   Cortex-M0    - 4 words per block
+ *
+ * Note: GCC assumes divided syntax for Thumb-1 inline assembly so unified syntax is
+ *       selected explicitly.
+ */
+#if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__)
+#define COMPARE_BLOCK_WORDS (8)
+#else
+#define COMPARE_BLOCK_WORDS (4)
+#endif
+
+/**
+ * Round a range down to a whole number of compare blocks
+ *
+ * @param address    Start of range
+ * @param endAddress End of range (exclusive)
+ *
+ * @return End of last whole block within the range
+ */
+static inline const uint32_t *blockEnd(const uint32_t *address, const uint32_t *endAddress) {
+   return address + ((endAddress-address) & ~(COMPARE_BLOCK_WORDS-1));
+}
+
+/**
+ * Find first block that is not blank (=0xFFFFFFFF)
+ *
+ * @param address    Start of range (word aligned)
+ * @param endAddress End of range (exclusive, whole number of blocks)
+ *
+ * @return Start of first block that is not blank or endAddress if all blank
+ */
+extern "C" __attribute__((naked, noinline))
+const uint32_t *findNotBlankBlock(const uint32_t *address, const uint32_t *endAddress) {
+#if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__)
+   __asm__ volatile (
+         "   .syntax unified                 \n"
+         "   push  {r4-r8}                   \n"
+         "1: cmp   r0,r1                     \n"
+         "   bhs   2f                        \n"
+         "   ldmia r0!,{r2-r8,r12}           \n" // 8 words
+         "   and   r2,r2,r3                  \n"
+         "   and   r4,r4,r5                  \n"
+         "   and   r6,r6,r7                  \n"
+         "   and   r8,r8,r12                 \n"
+         "   and   r2,r2,r4                  \n"
+         "   and   r6,r6,r8                  \n"
+         "   and   r2,r2,r6                  \n"
+         "   adds  r2,r2,#1                  \n" // 0xFFFFFFFF => 0
+         "   beq   1b                        \n"
+         "   subs  r0,r0,#32                 \n" // Back to start of failing block
+         "2: pop   {r4-r8}                   \n"
+         "   bx    lr                        \n"
+   );
+#else
+   __asm__ volatile (
+         "   .syntax unified                 \n"
+         "   push  {r4,r5}                   \n"
+         "1: cmp   r0,r1                     \n"
+         "   bhs   2f                        \n"
+         "   ldmia r0!,{r2-r5}               \n" // 4 words
+         "   ands  r2,r3                     \n"
+         "   ands  r4,r5                     \n"
+         "   ands  r2,r4                     \n"
+         "   adds  r2,#1                     \n" // 0xFFFFFFFF => 0
+         "   beq   1b                        \n"
+         "   subs  r0,#16                    \n" // Back to start of failing block
+         "2: pop   {r4,r5}                   \n"
+         "   bx    lr                        \n"
+   );
+#endif
+}
+
+/*==========================================================================================================
+ * Flash engine
+ *
+ * All family differences are resolved from the traits at compile time
+ * (or from the family selected at run-time by FtfxAutoTraits).
+ *
+ * @tparam Traits Family traits (see FtfxTraits.h)
+ */
+template<class Traits>
+class FtfxEngine_T {
+
+   static_assert(FamilySelect_T<Traits>::detected||(Traits::phraseSize == 4)||(Traits::phraseSize == 8), "Illegal phrase size");
+
+   //! Program command for phrase size
+   static uint32_t programCommand() {
+      return (Traits::phraseSize == 8)?F_PGM8:F_PGM4;
+   }
+
+   //! Background verify included in image
+   static constexpr bool backgroundVerifyEnabled = (Traits::options&OPT_BACKGROUND_VERIFY) != 0;
+
+   //! FSTAT errors cleared before each command
+   static constexpr uint8_t fstatErrors =
+         FTFX_FSTAT_ACCERR|FTFX_FSTAT_FPVIOL|(backgroundVerifyEnabled?FTFX_FSTAT_RDCOLLERR:0);
+
+public:
+   /**
+    * Select family (only if detected at run-time)
+    *
+    * Must be done before anything family specific
+    * A detected device is rejected if its RAM (when known) does not cover the linked image and buffer.
+    */
+   static void selectFamily(FlashData_t *flashData) {
+      if (!FamilySelect_T<Traits>::select(flashData->familyHint)) {
+         // Counters are not yet started
+         flashData->flags &= ~DO_RECORD_COUNTERS;
+         setErrorCode(FLASH_ERR_ILLEGAL_PARAMS);
+      }
+      if (FamilySelect_T<Traits>::detected) {
+         uint32_t ramEnd = Traits::Ram::end();
+         if ((ramEnd != 0) && (ramEnd < (uint32_t)__dataBuffer+(uint32_t)__dataBufferSize)) {
+            flashData->flags &= ~DO_RECORD_COUNTERS;
+            setErrorCode(FLASH_ERR_ILLEGAL_PARAMS);
+         }
+      }
+   }
+
+   /**
+    * Target set-up done on every entry (watch-dog etc.)
+    */
+   static void initTarget() {
+#if !defined(DEBUG)
+      if (Traits::disableNmi) {
+         SIM_CTRL_REG  |= SIM_CTRL_REG_NMIDIS;
+      }
+      Traits::Watchdog::disable();
+#endif
+   }
+
+   /**
+    * Does any initialisation required before accessing the Flash
+    */
+   static void initFlash(FlashData_t *flashData) {
+      // Do initialise flash every time
+
+      // Unprotect flash
+      flashData->controller->fprot0_3 = 0xFFFFFFFF;
+      if (Traits::hasFdprot) {
+         flashData->controller->fdprot   = 0xFF;
+      }
+      // Flash caching is only disabled while flash commands are in progress
+      Traits::Cache::enable();
+
+      flashData->flags &= ~DO_INIT_FLASH;
+   }
+
+   /**
+    * Mask interrupts & find NVIC pending bit of the flash command complete IRQ
+    *
+    * The IRQ number differs across devices so it is found as the pending bit that follows
+    * FCNFG.CCIE while no command is in progress (CCIF set).
+    * Interrupts left pending by the halted application are preserved.
+    */
+   static void initFlashIrq(volatile FlashController *controller) {
+      uint32_t pending;
+
+      // Nothing may be taken through this routine's vector table
+      __asm__ volatile ("cpsid i");
+
+      controller->fcnfg |= FTFX_FCNFG_CCIE;
+      (void)controller->fcnfg;
+      pending = NVIC_ISPR0;
+      controller->fcnfg &= ~FTFX_FCNFG_CCIE;
+      (void)controller->fcnfg;
+      NVIC_ICPR0 = pending;
+      // Requests still asserted are immediately pending again
+      flashIrqMask = pending & ~NVIC_ISPR0;
+      controller->fcnfg |= FTFX_FCNFG_CCIE;
+      (void)controller->fcnfg;
+      flashIrqMask &= NVIC_ISPR0;
+      controller->fcnfg &= ~FTFX_FCNFG_CCIE;
+      (void)controller->fcnfg;
+      NVIC_ICPR0 = flashIrqMask;
+      // Restore application interrupts discarded above
+      NVIC_ISPR0 = pending & ~flashIrqMask;
+   }
+
+   /**
+    * Launch Flash command (does not wait for completion)
+    *
+    * The FCCOB registers must not be changed until waitForCommand() or isCommandComplete()
+    * indicates the command has completed
+    */
+   static void launchCommand(volatile FlashController *controller) {
+      // Flash is about to change
+      Traits::Cache::disable();
+
+      // Clear any existing errors
+      controller->fstat = fstatErrors;
+
+      // Completion raises a (masked) interrupt which wakes waitForCommand() from WFE
+      SCB_SCR           |= SCB_SCR_SEVONPEND;
+      controller->fcnfg |= FTFX_FCNFG_CCIE;
+
+      // Launch command
+      controller->fstat = FTFX_FSTAT_CCIF;
+
+      // Discard flash interrupt left pending by previous command (CCIF is now clear)
+      NVIC_ICPR0 = flashIrqMask;
+   }
+
+   /**
+    * Check if Flash command launched by launchCommand() has completed
+    */
+   static bool isCommandComplete(volatile FlashController *controller) {
+      return (controller->fstat & FTFX_FSTAT_CCIF) != 0;
+   }
+
+   /**
+    * Wait for Flash command to complete & check for errors
+    *
+    * A failed check (MGSTAT0) is not treated as an error
+    *
+    * @return Flash status
+    */
+   static uint8_t waitForCommandStatus(volatile FlashController *controller) {
+      // Wait for command complete
+      while ((controller->fstat & FTFX_FSTAT_CCIF) == 0) {
+#if !defined(USE_DWT_CYCCNT)
+         if ((Traits::options&OPT_RECORD_COUNTERS) && (phaseCounter != 0)) {
+            // Keep extended tick count current during long commands
+            (void)getTicks();
+            continue;
+         }
+#endif
+         // Sleep until command complete interrupt becomes pending (poll if IRQ was not found)
+         if (flashIrqMask != 0) {
+            __asm__ volatile ("wfe");
+         }
+      }
+      controller->fcnfg &= ~FTFX_FCNFG_CCIE;
+      Traits::Cache::enable();
+      // Handle any errors
+      if ((controller->fstat & FTFX_FSTAT_FPVIOL ) != 0) {
+         setErrorCode(FLASH_ERR_PROG_FPVIOL);
+      }
+      if ((controller->fstat & FTFX_FSTAT_ACCERR ) != 0) {
+         setErrorCode(FLASH_ERR_PROG_ACCERR);
+      }
+      if (backgroundVerifyEnabled && ((controller->fstat & FTFX_FSTAT_RDCOLLERR ) != 0)) {
+         // Background range lies in the block being modified
+         setErrorCode(FLASH_ERR_ILLEGAL_PARAMS);
+      }
+      return controller->fstat;
+   }
+
+   /**
+    * Wait for Flash command to complete & check for errors
+    */
+   static void waitForCommand(volatile FlashController *controller) {
+      if ((waitForCommandStatus(controller) & FTFX_FSTAT_MGSTAT0) != 0) {
+         setErrorCode(FLASH_ERR_PROG_MGSTAT0);
+      }
+   }
+
+   /**
+    * Launch & wait for Flash command to complete
+    */
+   static void executeCommand(volatile FlashController *controller) {
+      launchCommand(controller);
+      waitForCommand(controller);
+   }
+
+   /**
+    * Verify part of the background range (DO_BACKGROUND_VERIFY)
+    *
+    * backgroundAddress/backgroundSize/backgroundData are advanced as words are verified
+    * so on failure backgroundAddress indicates the failing location.
+    *
+    * @param flashData - Data for operation
+    * @param maxWords  - Maximum number of words to verify in this call
+    */
+   static void backgroundVerify(FlashData_t *flashData, uint32_t maxWords) {
+      if (!backgroundVerifyEnabled || ((flashData->flags&DO_BACKGROUND_VERIFY) == 0)) {
+         return;
+      }
+      if ((flashData->backgroundAddress & 0x03) != 0) {
+         waitForCommand(flashData->controller);
+         setErrorCode(FLASH_ERR_ILLEGAL_PARAMS);
+      }
+      while ((flashData->backgroundSize >= 4) && (maxWords-- > 0)) {
+         if (*(uint32_t *)flashData->backgroundAddress != *flashData->backgroundData) {
+            // Let any erase in progress finish before reporting
+            waitForCommand(flashData->controller);
+            setErrorCode(FLASH_ERR_VERIFY_FAILED);
+         }
+         flashData->backgroundAddress += 4;
+         flashData->backgroundData++;
+         flashData->backgroundSize    -= 4;
+      }
+      if (flashData->backgroundSize < 4) {
+         flashData->flags &= ~DO_BACKGROUND_VERIFY;
+      }
+   }
+
+   /**
+    * Launch erase command & wait for completion
+    *
+    * If DO_BACKGROUND_VERIFY then the background range is verified while the erase is in progress.
+    * This relies on read-while-write so the background range must lie in a different
+    * flash block (PFLASH0/PFLASH1/FlexNVM) to the one being erased.
+    */
+   static void executeEraseCommand(FlashData_t *flashData) {
+      volatile FlashController *controller = flashData->controller;
+
+      launchCommand(controller);
+      while (backgroundVerifyEnabled && !isCommandComplete(controller) &&
+             ((flashData->flags&DO_BACKGROUND_VERIFY) != 0)) {
+         backgroundVerify(flashData, BACKGROUND_VERIFY_CHUNK);
+      }
+      waitForCommand(controller);
+   }
+
+   /**
+    * Converts Global address to address required by flash operations
+    *
+    * FlexNVM devices:
+    *    A23     = PFLASH/DFLASH selection
+    *    A31..24 = 0
+    */
+   static uint32_t fixAddress(uint32_t address) {
+      if (!Traits::hasFlexNvm) {
+         return address;
+      }
+      // Any address above this is assumed to be DFLASH and require A23=1
+      const uint32_t DFLASH_START_ADDRESS  = 0x10000000;
+
+      if (address>=DFLASH_START_ADDRESS) {
+         // A23 selects between PFLASH & DFLASH
+         address |= 1<<23;
+      }
+      // Discard unused byte as addresses are relative to start of Flash Block rather than Global
+      return (address &= 0xFFFFFF);
+   }
+
+   /**
+    * Erase flash block (or entire flash if no F_ERSBLK)
+    */
+   static void eraseFlashBlock(FlashData_t *flashData) {
+      if ((flashData->flags&DO_ERASE_BLOCK) == 0) {
+         return;
+      }
+      if (Traits::eraseBlockCommand == F_ERSBLK) {
+         flashData->controller->fccob0_3 = (F_ERSBLK << 24) | fixAddress(flashData->address);
+      }
+      else {
+         flashData->controller->fccob0_3 = (Traits::eraseBlockCommand << 24);
+      }
+      executeEraseCommand(flashData);
+      flashData->flags &= ~DO_ERASE_BLOCK;
+   }
+
+   /**
+    * Get size of section that may be programmed by a single F_PGMSEC
+    *
+    * Sections are staged in the lower half of FlexRAM so it must be available as RAM (RAMRDY).
+    * A section does not cross a sector boundary or include the security location.
+    * Data held elsewhere in FlexRAM is not used as it would be overwritten by staging.
+    *
+    * @param flashData  Structure describing operation
+    * @param address    Start of section (flash address)
+    * @param endAddress End of range being programmed
+    * @param data       Data for section
+    *
+    * @return Size of section (bytes) or 0 if data must be programmed by phrase
+    */
+   static uint32_t sectionSize(FlashData_t *flashData, uint32_t address, uint32_t endAddress, const uint32_t *data) {
+      // F_PGMSEC unit is 128 bits (FTFE) or 64 bits (FTFL)
+      uint32_t sectionUnit = 2*Traits::phraseSize;
+      uint32_t size;
+
+      if ((Traits::flexRamSize == 0) || ((flashData->controller->fcnfg&FTFX_FCNFG_RAMRDY) == 0) ||
+          (flashData->sectorSize == 0) || ((address&(sectionUnit-1)) != 0)) {
+         return 0;
+      }
+      if (((uint32_t)data != FLEXRAM_ADDRESS) && ((uint32_t)data-FLEXRAM_ADDRESS < Traits::flexRamSize)) {
+         return 0;
+      }
+      size = flashData->sectorSize-(address&(flashData->sectorSize-1U));
+      if (size > endAddress-address) {
+         size = endAddress-address;
+      }
+      if (size > Traits::flexRamSize/2U) {
+         size = Traits::flexRamSize/2U;
+      }
+      size &= ~(sectionUnit-1);
+      if ((address <= NV_FSEC_ADDRESS) && (NV_FSEC_ADDRESS < address+size)) {
+         return 0;
+      }
+      return size;
+   }
+
+   /**
+    * Program a range of flash from buffer
+    *
+    * Whole sections are staged in FlexRAM and programmed with F_PGMSEC when
+    * FlexRAM is available as RAM, otherwise each phrase is programmed.
+    *
+    * Returns an error if the security location is to be programmed
+    * to permanently lock the device
+    */
+   static void programRange(FlashData_t *flashData) {
+      volatile FlashController *controller = flashData->controller;
+      uint32_t         address    = fixAddress(flashData->address);
+      uint32_t         endAddress = address+flashData->dataSize;
+      const uint32_t  *data       = flashData->dataAddress;
+      uint32_t         skipped    = 0;
+
+      if ((flashData->flags&DO_PROGRAM_RANGE) == 0) {
+         return;
+      }
+      if ((address & (Traits::phraseSize-1)) != 0) {
+         setErrorCode(FLASH_ERR_ILLEGAL_PARAMS);
+      }
+      // Program phrases
+      while (address < endAddress) {
+         uint32_t size = sectionSize(flashData, address, endAddress, data);
+         if (size != 0) {
+            // Stage section in FlexRAM (unless already there) and program with a single command
+            volatile uint32_t *flexRam = (volatile uint32_t *)FLEXRAM_ADDRESS;
+            uint32_t           erased  = 0xFFFFFFFFUL;
+            for (uint32_t index=0; index<size/4; index++) {
+               erased &= data[index];
+               flexRam[index] = data[index];
+            }
+            if (erased == 0xFFFFFFFFUL) {
+               // Already erased value - skip command
+               skipped++;
+            }
+            else {
+               controller->fccob0_3 = (F_PGMSEC << 24) | address;
+               controller->fccob4_7 = (size/(2*Traits::phraseSize)) << 16;
+               executeCommand(controller);
+            }
+            data    += size/4;
+            address += size;
+            continue;
+         }
+         if (address == (NV_FSEC_ADDRESS&~(Traits::phraseSize-1))) {
+            // Check for permanent secure value (FSEC is the low byte of its word)
+            if ((data[(NV_FSEC_ADDRESS&(Traits::phraseSize-1))/4] & (FTFX_FSEC_MEEN_MASK)) == (FTFX_FSEC_MEEN_DISABLE)) {
+               setErrorCode(FLASH_ERR_ILLEGAL_SECURITY);
+            }
+         }
+         uint32_t erased = data[0];
+         if (Traits::phraseSize == 8) {
+            erased &= data[1];
+         }
+         if (erased == 0xFFFFFFFFUL) {
+            // Already erased value - skip command
+            skipped++;
+         }
+         else {
+            controller->fccob0_3 = (programCommand() << 24) | address;
+            controller->fccob4_7 = data[0];
+            if (Traits::phraseSize == 8) {
+               controller->fccob8_B = data[1];
+            }
+            executeCommand(controller);
+         }
+         data    += Traits::phraseSize/4;
+         address += Traits::phraseSize;
+      }
+      if ((Family::options&OPT_RECORD_COUNTERS) && ((flashData->flags&DO_RECORD_COUNTERS) != 0)) {
+         flashData->counters.programSkipped += skipped;
+      }
+      flashData->flags &= ~DO_PROGRAM_RANGE;
+   }
+
+   /**
+    * Program a range of flash with a repeated pattern (DO_FILL_RANGE)
+    *
+    * The pattern is expanded into a small buffer which is programmed repeatedly
+    * using programRange() so no data is transferred from the host.
+    * fillPattern[0] is programmed at the start of the range.
+    */
+   static void fillRange(FlashData_t *flashData) {
+      static uint32_t  buffer[FILL_CHUNK_SIZE/4] __attribute__((section(".flashData"))); // Not on (small) stack
+      uint32_t         startAddress = flashData->address;
+      uint32_t         size         = flashData->dataSize;
+      const uint32_t  *data         = flashData->dataAddress;
+
+      if (!(Traits::options&OPT_FILL_RANGE) || ((flashData->flags&DO_FILL_RANGE) == 0)) {
+         return;
+      }
+      if ((size&(Traits::phraseSize-1)) != 0) {
+         // Only whole phrases are programmed
+         setErrorCode(FLASH_ERR_ILLEGAL_PARAMS);
+      }
+      for (unsigned index=0; index<FILL_CHUNK_SIZE/4; index++) {
+         buffer[index] = flashData->fillPattern[index&1];
+      }
+      flashData->dataAddress = buffer;
+      while (flashData->address < startAddress+size) {
+         flashData->dataSize = startAddress+size-flashData->address;
+         if (flashData->dataSize > FILL_CHUNK_SIZE) {
+            flashData->dataSize = FILL_CHUNK_SIZE;
+         }
+         flashData->flags |= DO_PROGRAM_RANGE;
+         programRange(flashData);
+         flashData->address += FILL_CHUNK_SIZE;
+      }
+      flashData->address     = startAddress;
+      flashData->dataSize    = size;
+      flashData->dataAddress = data;
+      flashData->flags      &= ~DO_FILL_RANGE;
+   }
+
+   /**
+    * Copy a range of flash to another range of flash (DO_COPY_RANGE)
+    *
+    * dataAddress is the source and may be in flash.  Data is staged through a small
+    * buffer so programRange() never reads flash while a command is in progress.
+    * If DO_ERASE_RANGE is also set the destination sectors are erased first.
+    * The source must not overlap the destination (or the sectors being erased).
+    * dataSize must be a whole number of phrases.
+    * dataAddress is left unchanged so DO_VERIFY_RANGE compares the copy against the source.
+    */
+   static void copyRange(FlashData_t *flashData) {
+      static uint32_t  buffer[COPY_CHUNK_SIZE/4] __attribute__((section(".flashData"))); // Not on (small) stack
+      uint32_t         startAddress = flashData->address;
+      uint32_t         size         = flashData->dataSize;
+      const uint32_t  *data         = flashData->dataAddress;
+      const uint8_t   *source       = (const uint8_t *)data;
+      uint32_t         first        = startAddress;
+      uint32_t         last         = startAddress+size; // exclusive
+
+      if (!(Traits::options&OPT_COPY_RANGE) || ((flashData->flags&DO_COPY_RANGE) == 0)) {
+         return;
+      }
+      if ((size&(Traits::phraseSize-1)) != 0) {
+         // Only whole phrases are programmed
+         setErrorCode(FLASH_ERR_ILLEGAL_PARAMS);
+      }
+      if ((flashData->flags&DO_ERASE_RANGE) != 0) {
+         // Source must survive erasing whole destination sectors
+         first &= ~(flashData->sectorSize-1U);
+         last   = (last+flashData->sectorSize-1U)&~(flashData->sectorSize-1U);
+      }
+      if (((uint32_t)source < last) && (first < (uint32_t)source+size)) {
+         setErrorCode(FLASH_ERR_ILLEGAL_PARAMS);
+      }
+      // Erase ahead of copy
+      eraseRange(flashData);
+
+      flashData->dataAddress = buffer;
+      while (flashData->address < startAddress+size) {
+         flashData->dataSize = startAddress+size-flashData->address;
+         if (flashData->dataSize > COPY_CHUNK_SIZE) {
+            flashData->dataSize = COPY_CHUNK_SIZE;
+         }
+         for (uint32_t index=0; index<flashData->dataSize; index++) {
+            ((uint8_t *)buffer)[index] = *source++;
+         }
+         flashData->flags |= DO_PROGRAM_RANGE;
+         programRange(flashData);
+         flashData->address += COPY_CHUNK_SIZE;
+      }
+      flashData->address     = startAddress;
+      flashData->dataSize    = size;
+      flashData->dataAddress = data;
+      flashData->flags      &= ~DO_COPY_RANGE;
+   }
+
+   /*
+    * Verify a range of flash against buffer
+    */
+   static void verifyRange(FlashData_t *flashData) {
+      volatile FlashController *controller = flashData->controller;
+      uint32_t        address    = fixAddress(flashData->address);
+      uint32_t        endAddress = address+flashData->dataSize;
+      const uint32_t *data       = flashData->dataAddress;
+
+      if ((flashData->flags&DO_VERIFY_RANGE) == 0) {
+         return;
+      }
+      // Verify words
+      while (address < endAddress) {
+         controller->fccob0_3 = (F_PGMCHK << 24) | address;
+         controller->fccob4_7 = (F_USER_MARGIN<<24) | 0;
+         controller->fccob8_B = *data;
+         launchCommand(controller);
+         if ((waitForCommandStatus(controller) & FTFX_FSTAT_MGSTAT0) != 0) {
+            recordFailure(flashData, flashData->dataSize-(endAddress-address), FLASH_ERR_PROG_MGSTAT0);
+         }
+         address += 4;
+         data++;
+      }
+      flashData->flags &= ~DO_VERIFY_RANGE;
+   }
+
+   /**
+    * Check an erased sector is blank using the controller (F_RD1SEC at user margin)
+    *
+    * On failure flashData->address is set to the failing sector and FLASH_ERR_ERASE_FAILED
+    * is reported (with DO_SCAN_ERRORS the failure is recorded and checking continues).
+    *
+    * @param flashData Structure describing operation
+    * @param address   Start of sector (as used for F_ERSSCR)
+    */
+   static void eraseVerifySector(FlashData_t *flashData, uint32_t address) {
+      volatile FlashController *controller = flashData->controller;
+      uint32_t                  offset     = address-fixAddress(flashData->address); // may wrap for first sector
+
+      controller->fccob0_3 = (F_RD1SEC << 24) | address;
+      controller->fccob4_7 = ((flashData->sectorSize/Traits::verifyUnit) << 16) | (F_USER_MARGIN << 8);
+      launchCommand(controller);
+      if ((waitForCommandStatus(controller) & FTFX_FSTAT_MGSTAT0) != 0) {
+         if (!(Traits::options&OPT_SCAN_ERRORS) || ((flashData->flags&DO_SCAN_ERRORS) == 0)) {
+            flashData->address += offset;
+         }
+         recordFailure(flashData, offset, FLASH_ERR_ERASE_FAILED);
+      }
+   }
+
+   /**
+    * Erase a range of flash
+    *
+    * If DO_BLANK_CHECK_RANGE is also requested each sector is checked as it is erased
+    */
+   static void eraseRange(FlashData_t *flashData) {
+      uint32_t   address     = fixAddress(flashData->address);
+      uint32_t   endAddress  = address + flashData->dataSize-1; // inclusive
+      uint32_t   pageMask    = flashData->sectorSize-1U;
+
+      if ((flashData->flags&DO_ERASE_RANGE) == 0) {
+         return;
+      }
+      // Check for empty range before block rounding
+      if (flashData->dataSize == 0) {
+         return;
+      }
+      // Round start address to start of block (inclusive)
+      address &= ~pageMask;
+
+      // Round end address to end of block (inclusive)
+      endAddress |= pageMask;
+
+      // Erase each sector
+      while (address <= endAddress) {
+         flashData->controller->fccob0_3 = (F_ERSSCR << 24) | address;
+         executeEraseCommand(flashData);
+         if ((flashData->flags&DO_BLANK_CHECK_RANGE) != 0) {
+            eraseVerifySector(flashData, address);
+         }
+         // Advance to start of next sector
+         address += flashData->sectorSize;
+      }
+      // Sectors have already been blank checked by eraseVerifySector()
+      flashData->flags &= ~(DO_ERASE_RANGE|DO_BLANK_CHECK_RANGE);
+   }
+
+   /**
+    * Check that a range of flash is blank (=0xFFFF)
+    */
+   static void blankCheckRange(FlashData_t *flashData) {
+      uint32_t   address     = flashData->address;
+      uint32_t   endAddress  = address + flashData->dataSize;
+
+      if ((flashData->flags&DO_BLANK_CHECK_RANGE) == 0) {
+         return;
+      }
+      // Skip blank blocks quickly - remainder is checked a word at a time
+      if ((address&3) == 0) {
+         address = (uint32_t)findNotBlankBlock((const uint32_t *)address,
+                                               blockEnd((const uint32_t *)address, (const uint32_t *)endAddress));
+      }
+      while (address < endAddress) {
+         if (*(uint32_t *)address != 0xFFFFFFFFUL) {
+            recordFailure(flashData, flashData->dataSize-(endAddress-address), FLASH_ERR_ERASE_FAILED);
+         }
+         address += 4;
+      }
+      flashData->flags &= ~DO_BLANK_CHECK_RANGE;
+   }
+
+   /*
+    * Partition FlexNVM/EEPROM
+    */
+   static void programPartition(FlashData_t *flashData) {
+      volatile FlashController *controller = flashData->controller;
+      if (!Traits::hasFlexNvm || ((flashData->flags&DO_PARTITION_FLEXNVM) == 0)) {
+         return;
+      }
+      controller->fccob0_3 = (F_PGMPART << 24)|0;
+      controller->fccob4_7 = flashData->frequency;
+      executeCommand(controller);
+      flashData->flags &= ~DO_PARTITION_FLEXNVM;
+   }
+
+   /**
+    * Report largest free RAM region after image as data buffer (DO_SIZE_BUFFER)
+    *
+    * The region extends from the data buffer to the end of SRAM_U.  The end is taken from
+    * flashData->address if non-zero (supplied by host) otherwise from the device (Traits::Ram).
+    * The buffer reserved by the linker file is reported if neither is larger.
+    * dataAddress/dataSize are overwritten so this should be requested alone.
+    */
+   static void sizeBuffer(FlashData_t *flashData) {
+      uint32_t bufferEnd = (uint32_t)__dataBuffer+(uint32_t)__dataBufferSize;
+      uint32_t ramEnd    = flashData->address;
+
+      if (!(Traits::options&OPT_SIZE_BUFFER) || ((flashData->flags&DO_SIZE_BUFFER) == 0)) {
+         return;
+      }
+      if (ramEnd == 0) {
+         ramEnd = Traits::Ram::end();
+      }
+      if (ramEnd > bufferEnd) {
+         bufferEnd = ramEnd;
+      }
+      flashData->dataAddress = __dataBuffer;
+      flashData->dataSize    = bufferEnd-(uint32_t)__dataBuffer;
+      flashData->flags      &= ~DO_SIZE_BUFFER;
+   }
+
+   /**
+    * Report FlexRAM as a second data buffer (DO_FLEXRAM_BUFFER)
+    *
+    * FlexRAM is only available as RAM when not used for EEPROM (RAMRDY).
+    * dataSize is 0 if it is not available.  Data placed at the start of FlexRAM
+    * is programmed by F_PGMSEC without copying (up to half of FlexRAM).
+    * dataAddress/dataSize are overwritten so this should be requested alone.
+    */
+   static void flexRamBuffer(FlashData_t *flashData) {
+      if ((Traits::flexRamSize == 0) || ((flashData->flags&DO_FLEXRAM_BUFFER) == 0)) {
+         return;
+      }
+      flashData->dataAddress = (const uint32_t *)FLEXRAM_ADDRESS;
+      flashData->dataSize    = ((flashData->controller->fcnfg&FTFX_FCNFG_RAMRDY) != 0)?Traits::flexRamSize:0;
+      flashData->flags      &= ~DO_FLEXRAM_BUFFER;
+   }
+
+   /**
+    * Carry out the operations requested in flashData
+    *
+    * Each operation clears its DO_... flag when done
+    */
+   static void processRequest(FlashData_t *flashData) {
+      initCounters(flashData);
+      initFlashIrq(flashData->controller);
+      initScan(flashData);
+      initFlash(flashData);
+      startPhase(flashData, &flashData->counters.eraseTicks);
+      eraseFlashBlock(flashData);
+      programPartition(flashData);
+      copyRange(flashData);
+      eraseRange(flashData);
+      startPhase(flashData, &flashData->counters.blankCheckTicks);
+      blankCheckRange(flashData);
+      startPhase(flashData, &flashData->counters.programTicks);
+      programRange(flashData);
+      fillRange(flashData);
+      startPhase(flashData, &flashData->counters.verifyTicks);
+      // Complete any background verify not overlapped with an erase
+      backgroundVerify(flashData, 0xFFFFFFFFUL);
+      verifyRange(flashData);
+      reportScanErrors(flashData);
+      sizeBuffer(flashData);
+      flexRamBuffer(flashData);
+   }
+};
+
+//! Engine for selected family
+typedef FtfxEngine_T<Family> Engine;
+
+/**
+ * Main C entry point
+ *
+ * Assumes ramBuffer is set up beforehand
+ */
+void entry(void) {
+   // Set the interrupt vector table position
+   SCB_VTOR = (uint32_t)__vector_table;
+
+   // Handle on programming data
+   FlashData_t *flashData = gFlashProgramHeader.flashData;
+
+   agentMode = 0;
+   Engine::selectFamily(flashData);
+   Engine::initTarget();
+
+   Engine::processRequest(flashData);
+
+#ifndef DEBUG
+   // Indicate completed & stop
+   setErrorCode(FLASH_ERR_OK);
+#endif
+}
+
+/**
+ * Resident agent entry point (OPT_RESIDENT_AGENT)
+ *
+ * The host starts the target here once and then drives it purely by memory accesses.
+ * The agent services a request each time the host clears IS_COMPLETE in FlashData_t.flags:
+ *   - Host waits for IS_COMPLETE to be set (agent ready/previous request done)
+ *   - Host writes FlashData_t (and buffer) followed by flags with IS_COMPLETE clear
+ *   - Agent carries out the request and posts errorCode with IS_COMPLETE set
+ * The core is never halted so the per-operation halt/resume over the debug link is avoided.
+ */
+void agentEntry(void) {
+   // Set the interrupt vector table position
+   SCB_VTOR = (uint32_t)__vector_table;
+
+   agentMode = 0;
+   Engine::selectFamily(gFlashProgramHeader.flashData);
+   Engine::initTarget();
+
+   agentMode = 1;
+
+   // Indicate ready
+   gFlashProgramHeader.flashData->flags |= IS_COMPLETE;
+
+   agentLoop();
+}
+
+/**
+ * Wait for a request from the host and process it
+ *
+ * Re-entered via setErrorCode() with a fresh stack after each request
+ */
+void agentLoop(void) {
+   for(;;) {
+      FlashData_t *flashData = gFlashProgramHeader.flashData;
+      if ((((volatile FlashData_t *)flashData)->flags&IS_COMPLETE) == 0) {
+         flashData->errorCode = FLASH_ERR_OK;
+         Engine::processRequest(flashData);
+         setErrorCode(FLASH_ERR_OK);
+      }
+   }
+}
+
+/**
+ * Low level entry point
+ */
+__attribute__((naked))
+void asm_entry(void) {
+#ifndef DEBUG
+   // Setup the stack before we attempt anything else
+   __asm__ (
+   "mov   r0,%[stacktop]\n\t"
+   "mov   sp,r0\n\t"
+   "b     entry\n\t"
+   "bkpt  0\n\t"::[stacktop] "r" (__stacktop));
+#else
+   __asm__ (
+   "b     entry\n\t");
+#endif
+}
+
+/**
+ * Low level entry point for resident agent
+ */
+__attribute__((naked))
+void asm_agentEntry(void) {
+   // Setup the stack before we attempt anything else
+   __asm__ (
+   "mov   r0,%[stacktop]\n\t"
+   "mov   sp,r0\n\t"
+   "b     agentEntry\n\t"
+   "bkpt  0\n\t"::[stacktop] "r" (__stacktop));
+}
+
+/**
+ * Confirm image is intact
+ *
+ * Calculates CRC-32 of the code and constants [__checkStart, __checkEnd) and compares
+ * it with gFlashProgramHeader.buildHash set by the host when the image was loaded.
+ * Nothing outside this function is used so a damaged image is reported rather than executed.
+ */
+void selfCheck(void) {
+   FlashData_t   *flashData = gFlashProgramHeader.flashData;
+   const uint8_t *ptr       = (const uint8_t *)__checkStart;
+   uint32_t       crc       = 0xFFFFFFFFUL;
+
+   while (ptr < (const uint8_t *)__checkEnd) {
+      crc ^= *ptr++;
+      for (int bit=0; bit<8; bit++) {
+         crc = (crc>>1)^(0xEDB88320UL&(0-(crc&1)));
+      }
+   }
+   flashData->errorCode = (~crc == gFlashProgramHeader.buildHash)?FLASH_ERR_OK:FLASH_ERR_VERIFY_FAILED;
+   flashData->flags    |= IS_COMPLETE;
+   for(;;) {
+      __asm__("bkpt  0");
+   }
+}
+
+/**
+ * Low level entry point for self-check
+ */
+__attribute__((naked))
+void asm_selfCheck(void) {
+   __asm__ (
+   "mov   r0,%[stacktop]\n\t"
+   "mov   sp,r0\n\t"
+   "b     selfCheck\n\t"::[stacktop] "r" (__stacktop));
+}
+
+#ifndef DEBUG
+void asm_testApp(void) {
+}
+#else
+// Programming general flash
+static const uint8_t buffer[] = {0x00,0x11,0x22,0x33,0x44,0x55,0x66,0x77,0x88,0x99,0xAA,0xBB,0xCC,0xDD,0xEE,0xFF,
+                                 0x00,0x11,0x22,0x33,0x44,0x55,0x66,0x77,0x88,0x99,0xAA,0xBB,0xCC,0xDD,0xEE,0xFF};
+
+static const FlashData_t flashdataA = {
+   /* flags      */ DO_INIT_FLASH|DO_ERASE_RANGE|DO_BLANK_CHECK_RANGE|DO_PROGRAM_RANGE|DO_VERIFY_RANGE,
+   /* controller */ FTFX_BASE_ADDRESS,
+   /* frequency  */ 0,
+   /* errorCode  */ 0xAA55,
+   /* sectorSize */ FLASH_SECTOR_SIZE,
+   /* address    */ 0x00000840,
+   /* size       */ sizeof(buffer),
+   /* data       */ (const uint32_t *)buffer,
+};
+
+//! Dummy test program for debugging
+void testApp(void) {
+   FlashProgramHeader_t *fph = (FlashProgramHeader_t*) &gFlashProgramHeader;
+
+   // Set the interrupt vector table position
+   SCB_VTOR = (uint32_t)__vector_table;
+
+   FamilySelect::select(FTFX_HINT_DETECT);
+   Family::Watchdog::disable();
+
+   fph->flashData = (FlashData_t *)&flashdataA;
+   fph->entry();
+}
+
+//!
+//!
+__attribute__((naked))
+void asm_testApp(void) {
+   __asm__ (
+   // Setup the stack before we attempt anything else
+   "mov   r0,%[stacktop]\n\t"
+   "mov   sp,r0\n\t"
+   // execute testApp
+   "bl    testApp\n\t"
+   //
+   "bkpt  0\n\t"::[stacktop] "r" (__stacktop));
+}
+#endif
@@ -127,6 +127,9 @@ typedef struct {
 #define DO_VERIFY_RANGE       (1<<5) // Verify range
 #define DO_PARTITION_FLEXNVM  (1<<7) // Program FlexNVM DFLASH/EEPROM partitioning
 #define DO_TIMING_LOOP        (1<<8) // Counting loop to determine clock speed
+#define DO_FILL_RANGE         (1<<11) // Program range with FlashData_t.fillPattern (no data transferred)
+#define DO_RECORD_COUNTERS    (1<<14) // Record performance counters in FlashData_t
+#define DO_SIZE_BUFFER        (1<<27) // Report largest free RAM region after image in dataAddress/dataSize
 
 #define IS_COMPLETE           (1<<31)
                              
@@ -139,9 +142,14 @@ typedef struct {
 #define CAP_UNLOCK_FLASH       (1<<6)
 #define CAP_PARTITION_FLEXNVM  (1<<7)
 #define CAP_TIMING             (1<<8)
+#define CAP_FILL_RANGE         (1<<9)
+#define CAP_RECORD_COUNTERS    (1<<14)
+#define CAP_SIZE_BUFFER        (1<<28)
 
+#define CAP_HEADER_V2          (1<<10) // Indicates FlashProgramHeader_t.info is valid
 #define CAP_DSC_OVERLAY        (1<<11) // Indicates DSC code in pMEM overlays xRAM
 #define CAP_DATA_FIXED         (1<<12) // Indicates TargetFlashDataHeader is at fixed address
+#define CAP_SELF_CHECK         (1<<27) // Indicates FlashProgramHeader_t.selfCheck is valid
                                
 #define CAP_RELOCATABLE        (1<<31)
 
@@ -169,7 +177,19 @@ typedef enum {
 // This is the smallest unit of Flash that can be erased
 #define FLASH_SECTOR_SIZE  ((1<<10)/2) // 512b block size (used for stride in erase)
 
+// Size of buffer programmed repeatedly by fillRange() (DO_FILL_RANGE)
+#define FILL_CHUNK_SIZE (32)
+
 typedef void (*EntryPoint_t)(void);
+
+/** Performance counters (only written if DO_RECORD_COUNTERS) */
+typedef struct {
+   uint32_t eraseTicks;       // Ticks spent erasing (block, partition & range)
+   uint32_t blankCheckTicks;  // Ticks spent blank checking
+   uint32_t programTicks;     // Ticks spent programming
+   uint32_t verifyTicks;      // Ticks spent verifying
+   uint32_t programSkipped;   // Program commands skipped as data was all erased value
+} FlashCounters_t;
 #pragma pack(2)
 // Describes a block to be programmed & result
 typedef struct {
@@ -181,23 +201,123 @@ typedef struct {
    uint32_t                  address;           // Memory address being accessed
    uint32_t                  dataSize;          // Size of memory range being accessed
    const uint32_t           *dataAddress;       // Pointer to data to program
+   FlashCounters_t           counters;          // Performance counters (only if DO_RECORD_COUNTERS)
+   uint32_t                  fillPattern[2];    // Pattern repeated over range (only if DO_FILL_RANGE)
 } FlashData_t;
 
+/*==========================================================================================================
+ * Information records (CAP_HEADER_V2)
+ *
+ * FlashProgramHeader_t.info points to a list of tag/length/value records terminated by INFO_END.
+ * Values are in target byte order.  Records with unknown tags should be skipped using length.
+ */
+#define HEADER_VERSION       (2)
+
+#define INFO_END             (0) // End of list
+#define INFO_VERSION         (1) // Header version (HEADER_VERSION)
+#define INFO_PHRASE_SIZE     (2) // Minimum program unit (bytes)
+#define INFO_SECTOR_SIZE     (3) // Minimum erase unit (bytes)
+#define INFO_BUFFER_ADDRESS  (4) // First free location after image (suitable for data buffer)
+#define INFO_BUFFER_SIZE     (5) // Largest dataSize accepted by a single call (bytes)
+#define INFO_OPERATIONS      (6) // Supported operations (CAP_xxx mask)
+#define INFO_CLOCK           (7) // Clock requirement (INFO_CLOCK_xxx or assumed bus clock in kHz)
+#define INFO_ENDIAN          (8) // Byte order (INFO_ENDIAN_xxx)
+#define INFO_ADDRESS_UNIT    (9) // Size of addressable unit (bytes)
+#define INFO_CHECK_START     (10) // Start of range covered by FlashProgramHeader_t.buildHash
+#define INFO_CHECK_END       (11) // End of range covered by FlashProgramHeader_t.buildHash
+
+#define INFO_CLOCK_NONE      (0)            // Flash controller needs no clock set-up
+#define INFO_CLOCK_FREQUENCY (0xFFFFFFFFUL) // Flash clock divider is calculated from flashData->frequency
+#define INFO_CLOCK_HOST      (0xFFFFFFFEUL) // Flash clock divider must be set by host
+
+#define INFO_ENDIAN_LITTLE   (0)
+#define INFO_ENDIAN_BIG      (1)
+
+/** Information record */
+typedef struct {
+   uint16_t         tag;               // Type of record (INFO_xxx)
+   uint16_t         length;            // Size of value (bytes)
+   uint32_t         value;             // Value
+} FlashInfoRecord_t;
+
 //! Describe the flash programming code
 typedef struct {
    uint32_t        *loadAddress;       // Address where to load this image
    EntryPoint_t     entry;             // Pointer to entry routine
    uint32_t         capabilities;      // Capabilities of routine
    uint32_t         reserved1;
-   uint32_t         reserved2;
+   const FlashInfoRecord_t *info;      // Pointer to information records (CAP_HEADER_V2)
    FlashData_t     *flashData;         // Pointer to information about operation
+   uint32_t        buildHash;          // CRC-32 of image [INFO_CHECK_START,INFO_CHECK_END) - set by host (CAP_SELF_CHECK)
+   EntryPoint_t    selfCheck;          // Pointer to self-check routine (CAP_SELF_CHECK)
 } FlashProgramHeader_t;
 
 #pragma pack(0)
 
 extern uint32_t __loadAddress[];
+extern uint32_t __dataBuffer[];
+extern uint32_t __dataBufferSize[];
+extern uint32_t __checkStart[];
+extern uint32_t __checkEnd[];
 
 void asm_entry(void);
+void asm_selfCheck(void);
+
+/*==========================================================================================================
+ * Build options
+ *
+ * Optional operations are only included if selected by OPTIONS so that the default image
+ * still fits the small RAM layout (MKE02Z64_flash_0x1FFFFE00.ld, 2K RAM).
+ * Build with -DOPTIONS=OPT_ALL and MKE02Z64_flash_0x1FFFFC00.ld (4K RAM) for all operations.
+ */
+#define OPT_HEADER_V2          CAP_HEADER_V2       // Information records (FlashProgramHeader_t.info)
+#define OPT_DATA_FIXED         CAP_DATA_FIXED      // FlashData_t & data buffer reserved after image
+#define OPT_SELF_CHECK         CAP_SELF_CHECK      // Self-check entry (requires OPT_HEADER_V2|OPT_DATA_FIXED)
+#define OPT_FILL_RANGE         CAP_FILL_RANGE      // DO_FILL_RANGE
+#define OPT_RECORD_COUNTERS    CAP_RECORD_COUNTERS // DO_RECORD_COUNTERS
+#define OPT_SIZE_BUFFER        CAP_SIZE_BUFFER     // DO_SIZE_BUFFER (requires OPT_DATA_FIXED)
+
+#define OPT_ALL (OPT_HEADER_V2|OPT_DATA_FIXED|OPT_SELF_CHECK|OPT_FILL_RANGE|OPT_RECORD_COUNTERS|OPT_SIZE_BUFFER)
+
+#ifndef OPTIONS
+#define OPTIONS (OPT_HEADER_V2|OPT_DATA_FIXED|OPT_SELF_CHECK|OPT_SIZE_BUFFER)
+#endif
+
+#if ((OPTIONS&(OPT_SELF_CHECK|OPT_SIZE_BUFFER)) != 0) && ((OPTIONS&OPT_DATA_FIXED) == 0)
+#error "OPT_SELF_CHECK and OPT_SIZE_BUFFER require OPT_DATA_FIXED"
+#endif
+#if ((OPTIONS&OPT_SELF_CHECK) != 0) && ((OPTIONS&OPT_HEADER_V2) == 0)
+#error "OPT_SELF_CHECK requires OPT_HEADER_V2"
+#endif
+
+#define CAPABILITIES (CAP_BLANK_CHECK_RANGE|CAP_ERASE_RANGE|CAP_ERASE_BLOCK|CAP_PROGRAM_RANGE|\
+                      CAP_VERIFY_RANGE|CAP_PARTITION_FLEXNVM|OPTIONS)
+
+#if (OPTIONS&OPT_DATA_FIXED)
+/**
+ * Fixed location of FlashData_t (CAP_DATA_FIXED) - not part of loaded image
+ */
+FlashData_t gFlashData __attribute__((section(".flashData")));
+#endif
+
+#if (OPTIONS&OPT_HEADER_V2)
+/**
+ * Information records describing this routine
+ */
+const FlashInfoRecord_t flashInfo[] = {
+     {INFO_VERSION,        4, HEADER_VERSION},
+     {INFO_PHRASE_SIZE,    4, 1},
+     {INFO_BUFFER_ADDRESS, 4, (uint32_t)__dataBuffer},
+     {INFO_BUFFER_SIZE,    4, (uint32_t)__dataBufferSize},
+     {INFO_OPERATIONS,     4, CAPABILITIES},
+     {INFO_CLOCK,          4, 16000},
+     {INFO_ENDIAN,         4, INFO_ENDIAN_LITTLE},
+     {INFO_ADDRESS_UNIT,   4, 1},
+     {INFO_CHECK_START,    4, (uint32_t)__checkStart},
+     {INFO_CHECK_END,      4, (uint32_t)__checkEnd},
+     {INFO_END,            0, 0},
+};
+#endif
 
 /**
  * Flash programming command table
@@ -205,16 +325,34 @@ void asm_entry(void);
 volatile const FlashProgramHeader_t gFlashProgramHeader = {
      /* loadAddress  */ __loadAddress,     // load address of image
      /* entry        */ asm_entry,         // entry point for code
-     /* capabilities */ CAP_BLANK_CHECK_RANGE|CAP_ERASE_RANGE|CAP_ERASE_BLOCK|CAP_PROGRAM_RANGE|CAP_VERIFY_RANGE|CAP_PARTITION_FLEXNVM,
+     /* capabilities */ CAPABILITIES,
      /* Reserved1    */ 0,
-     /* Reserved2    */ 0,
-     /* flashData    */ NULL,
+#if (OPTIONS&OPT_HEADER_V2)
+     /* info         */ flashInfo,
+#else
+     /* info         */ NULL,
+#endif
+#if (OPTIONS&OPT_DATA_FIXED)
+     /* flashData    */ &gFlashData,       // fixed location (CAP_DATA_FIXED)
+#else
+     /* flashData    */ NULL,              // set by host
+#endif
+     /* buildHash    */ 0,                 // set by host when image is loaded
+#if (OPTIONS&OPT_SELF_CHECK)
+     /* selfCheck    */ asm_selfCheck,     // self-check entry point
+#else
+     /* selfCheck    */ NULL,
+#endif
 };
 
 void setErrorCode(int errorCode) __attribute__ ((noreturn));
 void initFlash(FlashData_t *flashData);
+void disableFlashCache(void);
+void enableFlashCache(void);
 void eraseFlashBlock(FlashData_t *flashData);
 void programRange(FlashData_t *flashData);
+void fillRange(FlashData_t *flashData);
+void sizeBuffer(FlashData_t *flashData);
 void verifyRange(FlashData_t *flashData);
 void eraseRange(FlashData_t *flashData);
 void blankCheckRange(FlashData_t *flashData);
@@ -231,11 +369,115 @@ void isr_default(void) {
    setErrorCode(FLASH_ERR_TRAP);
 }
 
+/*==========================================================================================================
+ * Performance counters (DO_RECORD_COUNTERS)
+ *
+ * Ticks are core clock cycles:
+ *   Cortex-M3/M4 - DWT cycle counter
+ *   Cortex-M0    - SysTick extended to 32-bits in software
+ */
+#if (OPTIONS&OPT_RECORD_COUNTERS)
+#if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__)
+#define USE_DWT_CYCCNT
+#endif
+
+#if defined(USE_DWT_CYCCNT)
+#define DEMCR                 (*(volatile uint32_t *)0xE000EDFC)
+#define DEMCR_TRCENA          (1<<24)
+#define DWT_CTRL              (*(volatile uint32_t *)0xE0001000)
+#define DWT_CTRL_CYCCNTENA    (1<<0)
+#define DWT_CYCCNT            (*(volatile uint32_t *)0xE0001004)
+#else
+#define SYST_CSR              (*(volatile uint32_t *)0xE000E010)
+#define SYST_RVR              (*(volatile uint32_t *)0xE000E014)
+#define SYST_CVR              (*(volatile uint32_t *)0xE000E018)
+#define SYST_CSR_ENABLE       (1<<0)
+#define SYST_CSR_CLKSOURCE    (1<<2)
+#define SYST_MAX_COUNT        (0x00FFFFFF)
+
+//! SysTick value when last sampled
+static uint32_t lastSysTick;
+//! Extended tick count
+static uint32_t tickCount;
+#endif
+
+//! Counter for phase in progress (NULL if none)
+static uint32_t *phaseCounter;
+//! Tick count at start of phase in progress
+static uint32_t  phaseStart;
+
+/**
+ * Get current tick count
+ *
+ * @note On Cortex-M0 this must be called at least every 2^24 cycles
+ */
+uint32_t getTicks(void) {
+#if defined(USE_DWT_CYCCNT)
+   return DWT_CYCCNT;
+#else
+   uint32_t now = SYST_CVR;
+   // SysTick counts down
+   tickCount   += (lastSysTick-now)&SYST_MAX_COUNT;
+   lastSysTick  = now;
+   return tickCount;
+#endif
+}
+
+/**
+ * Clear counters and start tick source if DO_RECORD_COUNTERS
+ */
+void initCounters(FlashData_t *flashData) {
+   phaseCounter = NULL;
+   if ((flashData->flags&DO_RECORD_COUNTERS) == 0) {
+      return;
+   }
+   flashData->counters.eraseTicks      = 0;
+   flashData->counters.blankCheckTicks = 0;
+   flashData->counters.programTicks    = 0;
+   flashData->counters.verifyTicks     = 0;
+   flashData->counters.programSkipped  = 0;
+#if defined(USE_DWT_CYCCNT)
+   DEMCR      |= DEMCR_TRCENA;
+   DWT_CTRL   |= DWT_CTRL_CYCCNTENA;
+#else
+   SYST_CSR    = 0;
+   SYST_RVR    = SYST_MAX_COUNT;
+   SYST_CVR    = 0;
+   SYST_CSR    = SYST_CSR_CLKSOURCE|SYST_CSR_ENABLE;
+   lastSysTick = SYST_CVR;
+   tickCount   = 0;
+#endif
+}
+
+/**
+ * Accumulate ticks for phase in progress and start a new phase
+ *
+ * @param flashData Pointer to flash programming information
+ * @param counter   Counter for new phase (NULL to just end phase in progress)
+ */
+void startPhase(FlashData_t *flashData, uint32_t *counter) {
+   uint32_t now;
+   if ((flashData->flags&DO_RECORD_COUNTERS) == 0) {
+      return;
+   }
+   now = getTicks();
+   if (phaseCounter != NULL) {
+      *phaseCounter += now-phaseStart;
+   }
+   phaseCounter = counter;
+   phaseStart   = now;
+}
+#else
+#define initCounters(flashData)
+#define startPhase(flashData, counter)
+#endif
+
 /**
  * Set error code to return to BDM & halt
  */
 void setErrorCode(int errorCode) {
    FlashData_t *flashData = gFlashProgramHeader.flashData;
+   startPhase(flashData, NULL);
    flashData->errorCode   = (uint16_t)errorCode;
    flashData->flags      |= IS_COMPLETE; 
    for(;;) {
@@ -243,6 +485,22 @@ void setErrorCode(int errorCode) {
    }
 }
 
+/**
+ * Disable flash cache & speculation while a flash command is in progress
+ */
+void disableFlashCache(void) {
+   MCM_PLACR = (MCM_PLACR_DFCS|MCM_PLACR_DFCC|MCM_PLACR_DFCIC|MCM_PLACR_DFCDA|MCM_PLACR_CFCC);
+}
+
+/**
+ * Invalidate & re-enable flash cache & speculation after a flash command
+ *
+ * This allows CPU-side blank check & verify to run at cached speed
+ */
+void enableFlashCache(void) {
+   MCM_PLACR = MCM_PLACR_CFCC;
+}
+
 /**
  * Does any initialisation required before accessing the Flash
  */
@@ -255,8 +513,8 @@ void initFlash(FlashData_t *flashData) {
    controller->fprot   = 0xFF;  // Unprotect Flash
    controller->eeprot  = 0xFF;  // Unprotect EEprom
 
-   // Disable Flash cache
-   MCM_PLACR = (MCM_PLACR_DFCS|MCM_PLACR_DFCC|MCM_PLACR_DFCIC|MCM_PLACR_DFCDA|MCM_PLACR_CFCC);
+   // Flash caching is only disabled while flash commands are in progress
+   enableFlashCache();
    
    // Disable NMI (V4.11.1.70)
 //   SIM_SOPT  &= ~SIM_SOPT_NMIE; // Removed as makes it impossible to debug NMI
@@ -273,13 +531,23 @@ void executeCommand(volatile FlashController *controller) {
    
    pFstat = &controller->fstat;
    
+   // Flash is about to change
+   disableFlashCache();
+
    // Launch command
    *pFstat = FSTAT_CCIF;
 
    // Wait for command complete
    do {
+#if (OPTIONS&OPT_RECORD_COUNTERS) && !defined(USE_DWT_CYCCNT)
+      if (phaseCounter != NULL) {
+         // Keep extended tick count current during long commands
+         (void)getTicks();
+      }
+#endif
       fstat = *pFstat;
    } while ((fstat&(FSTAT_CCIF|FSTAT_ACCERR|FSTAT_FPVIOL)) == 0);
+   enableFlashCache();
    if ((fstat & FSTAT_ACCERR) != 0) {
       setErrorCode(FLASH_ERR_PROG_ACCERR);
    }
@@ -327,6 +595,7 @@ void programRange(FlashData_t *flashData) {
    uint32_t         address    = flashData->address;
    uint32_t         endAddress = flashData->address+flashData->dataSize;
    const uint8_t   *data       = (uint8_t*)flashData->dataAddress;
+   uint32_t         skipped    = 0;
    
    if ((flashData->flags&DO_PROGRAM_RANGE) == 0) {
       return;
@@ -336,6 +605,13 @@ void programRange(FlashData_t *flashData) {
 
    // Program 1 byte
    while (address < endAddress) { // Exclusive end address
+      if (*data == 0xFF) {
+         // Already erased value - skip command
+         skipped++;
+         data++;
+         address++;
+         continue;
+      }
       // Write command & address
       controller->fccobix = 0; controller->fccob.high = FCMD_PROGRAM_EEPROM; 
       /*                    */ controller->fccob.low  = (uint8_t)(address>>16);
@@ -348,9 +624,54 @@ void programRange(FlashData_t *flashData) {
       controller->fccobix = 2; controller->fccob.low = *data++;
       executeCommand(controller);
    }
+#if (OPTIONS&OPT_RECORD_COUNTERS)
+   if ((flashData->flags&DO_RECORD_COUNTERS) != 0) {
+      flashData->counters.programSkipped += skipped;
+   }
+#endif
    flashData->flags &= ~DO_PROGRAM_RANGE;
 }
 
+#if (OPTIONS&OPT_FILL_RANGE)
+/**
+ * Program a range of flash with a repeated pattern (DO_FILL_RANGE)
+ *
+ * The pattern is expanded into a small buffer which is programmed repeatedly
+ * using programRange() so no data is transferred from the host.
+ * fillPattern[0] is programmed at the start of the range.
+ */
+void fillRange(FlashData_t *flashData) {
+   static uint32_t  buffer[FILL_CHUNK_SIZE/4] __attribute__((section(".flashData"))); // Not on (small) stack
+   uint32_t         startAddress = flashData->address;
+   uint32_t         size         = flashData->dataSize;
+   const uint32_t  *data         = flashData->dataAddress;
+   int              index;
+
+   if ((flashData->flags&DO_FILL_RANGE) == 0) {
+      return;
+   }
+   for (index=0; index<FILL_CHUNK_SIZE/4; index++) {
+      buffer[index] = flashData->fillPattern[index&1];
+   }
+   flashData->dataAddress = buffer;
+   while (flashData->address < startAddress+size) {
+      flashData->dataSize = startAddress+size-flashData->address;
+      if (flashData->dataSize > FILL_CHUNK_SIZE) {
+         flashData->dataSize = FILL_CHUNK_SIZE;
+      }
+      flashData->flags |= DO_PROGRAM_RANGE;
+      programRange(flashData);
+      flashData->address += FILL_CHUNK_SIZE;
+   }
+   flashData->address     = startAddress;
+   flashData->dataSize    = size;
+   flashData->dataAddress = data;
+   flashData->flags      &= ~DO_FILL_RANGE;
+}
+#else
+#define fillRange(flashData)
+#endif
+
 /*
  * Verify a range of flash against buffer
  */
@@ -434,6 +755,33 @@ void blankCheckRange(FlashData_t *flashData) {
    flashData->flags &= ~DO_BLANK_CHECK_RANGE;
 }
 
+#if (OPTIONS&OPT_SIZE_BUFFER)
+/**
+ * Report largest free RAM region after image as data buffer (DO_SIZE_BUFFER)
+ *
+ * The region extends from the data buffer to the end of SRAM_U.  The end is taken from
+ * flashData->address (supplied by host) as the SRAM size is not available from the device.
+ * The buffer reserved by the linker file is reported if that is not larger.
+ * dataAddress/dataSize are overwritten so this should be requested alone.
+ */
+void sizeBuffer(FlashData_t *flashData) {
+   uint32_t bufferEnd = (uint32_t)__dataBuffer+(uint32_t)__dataBufferSize;
+   uint32_t ramEnd    = flashData->address;
+
+   if ((flashData->flags&DO_SIZE_BUFFER) == 0) {
+      return;
+   }
+   if (ramEnd > bufferEnd) {
+      bufferEnd = ramEnd;
+   }
+   flashData->dataAddress = __dataBuffer;
+   flashData->dataSize    = bufferEnd-(uint32_t)__dataBuffer;
+   flashData->flags      &= ~DO_SIZE_BUFFER;
+}
+#else
+#define sizeBuffer(flashData)
+#endif
+
 //! Minimal vector table
 extern uint32_t __vector_table[];
 
@@ -469,12 +817,19 @@ void entry(void) {
    // No errors so far
    flashData->errorCode = FLASH_ERR_OK;
    
+   initCounters(flashData);
    initFlash(flashData);
+   startPhase(flashData, &flashData->counters.eraseTicks);
    eraseFlashBlock(flashData);
    eraseRange(flashData);
+   startPhase(flashData, &flashData->counters.blankCheckTicks);
    blankCheckRange(flashData);
+   startPhase(flashData, &flashData->counters.programTicks);
    programRange(flashData);
+   fillRange(flashData);
+   startPhase(flashData, &flashData->counters.verifyTicks);
    verifyRange(flashData);
+   sizeBuffer(flashData);
    
 #ifndef DEBUG
    // Indicate completed & stop
@@ -500,6 +855,45 @@ void asm_entry(void) {
 #endif
 }
 
+#if (OPTIONS&OPT_SELF_CHECK)
+/**
+ * Confirm image is intact
+ *
+ * Calculates CRC-32 of the code and constants [__checkStart, __checkEnd) and compares
+ * it with gFlashProgramHeader.buildHash set by the host when the image was loaded.
+ * The host uses this to re-use an image still resident in RAM instead of loading it again.
+ * Nothing outside this function is used so a damaged image is reported rather than executed.
+ */
+void selfCheck(void) {
+   FlashData_t   *flashData = gFlashProgramHeader.flashData;
+   const uint8_t *ptr       = (const uint8_t *)__checkStart;
+   uint32_t       crc       = 0xFFFFFFFFUL;
+
+   while (ptr < (const uint8_t *)__checkEnd) {
+      crc ^= *ptr++;
+      for (int bit=0; bit<8; bit++) {
+         crc = (crc>>1)^(0xEDB88320UL&(0-(crc&1)));
+      }
+   }
+   flashData->errorCode = (~crc == gFlashProgramHeader.buildHash)?FLASH_ERR_OK:FLASH_ERR_VERIFY_FAILED;
+   flashData->flags    |= IS_COMPLETE;
+   for(;;) {
+      __asm__("bkpt  0");
+   }
+}
+
+/**
+ * Low level entry point for self-check
+ */
+__attribute__((naked))
+void asm_selfCheck(void) {
+   __asm__ (
+   "mov   r0,%[stacktop]\n\t"
+   "mov   sp,r0\n\t"
+   "b     selfCheck\n\t"::[stacktop] "r" (__stacktop));
+}
+#endif
+
 #ifndef DEBUG
 void asm_testApp(void) {
 }
@@ -88,6 +88,8 @@
 #define DO_PROGRAM_RANGE          (1<<4) // Program range (including option region)
 #define DO_VERIFY_RANGE           (1<<5) // Verify range
 #define DO_TIMING_LOOP            (1<<8) // Counting loop to determine clock speed
+#define DO_FILL_RANGE             (1<<11) // Program range with FlashData_t.fillPattern (no data transferred)
+#define DO_RECORD_COUNTERS    (1<<14) // Record performance counters in FlashData_t
 
 #define IS_COMPLETE               (1<<31)
 
@@ -100,9 +102,13 @@
 #define CAP_UNLOCK_FLASH          (1<<6)
 #define CAP_PARTITION_FLEXNVM     (1<<7)
 #define CAP_TIMING                (1<<8)
+#define CAP_FILL_RANGE            (1<<9)
+#define CAP_RECORD_COUNTERS    (1<<14)
 
+#define CAP_HEADER_V2          (1<<10) // Indicates FlashProgramHeader_t.info is valid
 #define CAP_DSC_OVERLAY           (1<<11) // Indicates DSC code in pMEM overlays xRAM
 #define CAP_DATA_FIXED            (1<<12) // Indicates TargetFlashDataHeader is at fixed address
+#define CAP_SELF_CHECK            (1<<27) // Indicates FlashProgramHeader_t.selfCheck is valid
 
 #define CAP_RELOCATABLE           (1<<31)
 
@@ -211,9 +217,21 @@ typedef uint32_t *RomTable[];
 /** Ptr to table of clock/power functions */
 #define POWER_API_FUNCTION_TABLE ((RomEntry_t *)(ROM_DRIVER_TABLE[3]))
 
+// Size of buffer programmed repeatedly by fillRange() (DO_FILL_RANGE)
+#define FILL_CHUNK_SIZE (256)
+
 /** Type for entry to flash code */
 typedef void (*EntryPoint_t)(void);
 
+/** Performance counters (only written if DO_RECORD_COUNTERS) */
+typedef struct {
+   uint32_t eraseTicks;       // Ticks spent erasing (block, partition & range)
+   uint32_t blankCheckTicks;  // Ticks spent blank checking
+   uint32_t programTicks;     // Ticks spent programming
+   uint32_t verifyTicks;      // Ticks spent verifying
+   uint32_t programSkipped;   // Program commands skipped as data was all erased value
+} FlashCounters_t;
+
 #pragma pack(push, 2)
 /** Describes a block to be programmed & result */
 typedef struct {
@@ -225,23 +243,94 @@ typedef struct {
    uint32_t            address;     // Memory address being accessed
    uint32_t            dataSize;    // Size of memory range being accessed
    uint32_t            dataAddress; // Pointer to data to program
+   FlashCounters_t     counters;    // Performance counters (only if DO_RECORD_COUNTERS)
+   uint32_t            fillPattern[2]; // Pattern repeated over range (only if DO_FILL_RANGE)
 } FlashData_t;
 
+/*==========================================================================================================
+ * Information records (CAP_HEADER_V2)
+ *
+ * FlashProgramHeader_t.info points to a list of tag/length/value records terminated by INFO_END.
+ * Values are in target byte order.  Records with unknown tags should be skipped using length.
+ */
+#define HEADER_VERSION       (2)
+
+#define INFO_END             (0) // End of list
+#define INFO_VERSION         (1) // Header version (HEADER_VERSION)
+#define INFO_PHRASE_SIZE     (2) // Minimum program unit (bytes)
+#define INFO_SECTOR_SIZE     (3) // Minimum erase unit (bytes)
+#define INFO_BUFFER_ADDRESS  (4) // First free location after image (suitable for data buffer)
+#define INFO_BUFFER_SIZE     (5) // Largest dataSize accepted by a single call (bytes)
+#define INFO_OPERATIONS      (6) // Supported operations (CAP_xxx mask)
+#define INFO_CLOCK           (7) // Clock requirement (INFO_CLOCK_xxx or assumed bus clock in kHz)
+#define INFO_ENDIAN          (8) // Byte order (INFO_ENDIAN_xxx)
+#define INFO_ADDRESS_UNIT    (9) // Size of addressable unit (bytes)
+#define INFO_CHECK_START     (10) // Start of range covered by FlashProgramHeader_t.buildHash
+#define INFO_CHECK_END       (11) // End of range covered by FlashProgramHeader_t.buildHash
+
+#define INFO_CLOCK_NONE      (0)            // Flash controller needs no clock set-up
+#define INFO_CLOCK_FREQUENCY (0xFFFFFFFFUL) // Flash clock divider is calculated from flashData->frequency
+#define INFO_CLOCK_HOST      (0xFFFFFFFEUL) // Flash clock divider must be set by host
+
+#define INFO_ENDIAN_LITTLE   (0)
+#define INFO_ENDIAN_BIG      (1)
+
+/** Information record */
+typedef struct {
+   uint16_t         tag;               // Type of record (INFO_xxx)
+   uint16_t         length;            // Size of value (bytes)
+   uint32_t         value;             // Value
+} FlashInfoRecord_t;
+
 /** Describe the flash programming code */
 typedef struct {
    uint32_t           *loadAddress;       // Address where to load this image
    EntryPoint_t        entry;             // Pointer to entry routine
    uint32_t            capabilities;      // Capabilities of routine
    uint32_t            reserved1;
-   uint32_t            reserved2;
+   const FlashInfoRecord_t *info;      // Pointer to information records (CAP_HEADER_V2)
    FlashData_t        *flashData;         // Pointer to information about operation
+   uint32_t           buildHash;          // CRC-32 of image [INFO_CHECK_START,INFO_CHECK_END) - set by host (CAP_SELF_CHECK)
+   EntryPoint_t       selfCheck;          // Pointer to self-check routine (CAP_SELF_CHECK)
 } FlashProgramHeader_t;
 #pragma pack(pop)
 
 /** Address at which code was located by linker */
 extern uint32_t __loadAddress[];
+extern uint32_t __dataBuffer[];
+extern uint32_t __dataBufferSize[];
+extern uint32_t __checkStart[];
+extern uint32_t __checkEnd[];
 
 void asm_entry(void);
+void asm_selfCheck(void);
+
+#define CAPABILITIES (CAP_BLANK_CHECK_RANGE|CAP_ERASE_RANGE|CAP_ERASE_BLOCK|CAP_PROGRAM_RANGE|\
+                      CAP_VERIFY_RANGE|CAP_PARTITION_FLEXNVM|CAP_RECORD_COUNTERS|CAP_HEADER_V2|\
+                      CAP_SELF_CHECK|CAP_FILL_RANGE|CAP_DATA_FIXED)
+
+/**
+ * Fixed location of FlashData_t (CAP_DATA_FIXED) - not part of loaded image
+ */
+FlashData_t gFlashData __attribute__((section(".flashData")));
+
+/**
+ * Information records describing this routine
+ */
+const FlashInfoRecord_t flashInfo[] = {
+     {INFO_VERSION,        4, HEADER_VERSION},
+     {INFO_PHRASE_SIZE,    4, 256},
+     {INFO_SECTOR_SIZE,    4, FLASH_SECTOR_SIZE},
+     {INFO_BUFFER_ADDRESS, 4, (uint32_t)__dataBuffer},
+     {INFO_BUFFER_SIZE,    4, (uint32_t)__dataBufferSize},
+     {INFO_OPERATIONS,     4, CAPABILITIES},
+     {INFO_CLOCK,          4, RESET_CLOCK_FREQ_kHz},
+     {INFO_ENDIAN,         4, INFO_ENDIAN_LITTLE},
+     {INFO_ADDRESS_UNIT,   4, 1},
+     {INFO_CHECK_START,    4, (uint32_t)__checkStart},
+     {INFO_CHECK_END,      4, (uint32_t)__checkEnd},
+     {INFO_END,            0, 0},
+};
 
 /**
  * Flash programming command table
@@ -249,12 +338,112 @@ void asm_entry(void);
 volatile const FlashProgramHeader_t gFlashProgramHeader = {
       /* loadAddress  */ __loadAddress,     // load address of image
       /* entry        */ asm_entry,         // entry point for code
-      /* capabilities */ CAP_BLANK_CHECK_RANGE|CAP_ERASE_RANGE|CAP_ERASE_BLOCK|CAP_PROGRAM_RANGE|CAP_VERIFY_RANGE|CAP_PARTITION_FLEXNVM,
+      /* capabilities */ CAPABILITIES,
       /* Reserved1    */ 0,
-      /* Reserved2    */ 0,
-      /* flashData    */ NULL,
+      /* info         */ flashInfo,
+      /* flashData    */ &gFlashData,       // fixed location (CAP_DATA_FIXED)
+      /* buildHash    */ 0,                 // set by host when image is loaded
+      /* selfCheck    */ asm_selfCheck,     // self-check entry point
 };
 
+/*==========================================================================================================
+ * Performance counters (DO_RECORD_COUNTERS)
+ *
+ * Ticks are core clock cycles:
+ *   Cortex-M3/M4 - DWT cycle counter
+ *   Cortex-M0    - SysTick extended to 32-bits in software
+ */
+#if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__)
+#define USE_DWT_CYCCNT
+#endif
+
+#if defined(USE_DWT_CYCCNT)
+#define DEMCR                 (*(volatile uint32_t *)0xE000EDFC)
+#define DEMCR_TRCENA          (1<<24)
+#define DWT_CTRL              (*(volatile uint32_t *)0xE0001000)
+#define DWT_CTRL_CYCCNTENA    (1<<0)
+#define DWT_CYCCNT            (*(volatile uint32_t *)0xE0001004)
+#else
+#define SYST_CSR              (*(volatile uint32_t *)0xE000E010)
+#define SYST_RVR              (*(volatile uint32_t *)0xE000E014)
+#define SYST_CVR              (*(volatile uint32_t *)0xE000E018)
+#define SYST_CSR_ENABLE       (1<<0)
+#define SYST_CSR_CLKSOURCE    (1<<2)
+#define SYST_MAX_COUNT        (0x00FFFFFF)
+
+//! SysTick value when last sampled
+static uint32_t lastSysTick;
+//! Extended tick count
+static uint32_t tickCount;
+#endif
+
+//! Counter for phase in progress (NULL if none)
+static uint32_t *phaseCounter;
+//! Tick count at start of phase in progress
+static uint32_t  phaseStart;
+
+/**
+ * Get current tick count
+ *
+ * @note On Cortex-M0 this must be called at least every 2^24 cycles
+ */
+uint32_t getTicks(void) {
+#if defined(USE_DWT_CYCCNT)
+   return DWT_CYCCNT;
+#else
+   uint32_t now = SYST_CVR;
+   // SysTick counts down
+   tickCount   += (lastSysTick-now)&SYST_MAX_COUNT;
+   lastSysTick  = now;
+   return tickCount;
+#endif
+}
+
+/**
+ * Clear counters and start tick source if DO_RECORD_COUNTERS
+ */
+void initCounters(FlashData_t *flashData) {
+   phaseCounter = NULL;
+   if ((flashData->flags&DO_RECORD_COUNTERS) == 0) {
+      return;
+   }
+   flashData->counters.eraseTicks      = 0;
+   flashData->counters.blankCheckTicks = 0;
+   flashData->counters.programTicks    = 0;
+   flashData->counters.verifyTicks     = 0;
+   flashData->counters.programSkipped  = 0;
+#if defined(USE_DWT_CYCCNT)
+   DEMCR      |= DEMCR_TRCENA;
+   DWT_CTRL   |= DWT_CTRL_CYCCNTENA;
+#else
+   SYST_CSR    = 0;
+   SYST_RVR    = SYST_MAX_COUNT;
+   SYST_CVR    = 0;
+   SYST_CSR    = SYST_CSR_CLKSOURCE|SYST_CSR_ENABLE;
+   lastSysTick = SYST_CVR;
+   tickCount   = 0;
+#endif
+}
+
+/**
+ * Accumulate ticks for phase in progress and start a new phase
+ *
+ * @param flashData Pointer to flash programming information
+ * @param counter   Counter for new phase (NULL to just end phase in progress)
+ */
+void startPhase(FlashData_t *flashData, uint32_t *counter) {
+   uint32_t now;
+   if ((flashData->flags&DO_RECORD_COUNTERS) == 0) {
+      return;
+   }
+   now = getTicks();
+   if (phaseCounter != NULL) {
+      *phaseCounter += now-phaseStart;
+   }
+   phaseCounter = counter;
+   phaseStart   = now;
+}
+
 /**
  * Set error code to return to BDM & halt if errro set
  */
@@ -265,6 +454,7 @@ void setErrorCode(int errorCode) {
    }
    // Set error code and halt
    FlashData_t *flashData = gFlashProgramHeader.flashData;
+   startPhase(flashData, NULL);
    flashData->errorCode   = (uint16_t)errorCode;
    flashData->flags      |= IS_COMPLETE;
    for(;;) {
@@ -372,25 +562,226 @@ void programRange(FlashData_t *flashData) {
    uint32_t         address    = flashData->address;
    uint32_t         data       = flashData->dataAddress;
    uint32_t         size       = flashData->dataSize;
+   uint32_t         skipped    = 0;
 
    if ((flashData->flags&DO_PROGRAM_RANGE) == 0) {
       return;
    }
    while (size>0) {
       // Do in 256 byte blocks
-      uint32_t blockSize = size;
+      uint32_t        blockSize = size;
+      const uint8_t  *ptr       = (const uint8_t *)data;
+      uint8_t         erased    = 0xFF;
+      uint32_t        count;
       if (blockSize>256) {
          blockSize = 256;
       }
-      prepareSectors(address>>12, address>>12);
-      copyRamtoRom(address, data, blockSize, RESET_CLOCK_FREQ_kHz);
+      for (count=0; count<blockSize; count++) {
+         erased &= ptr[count];
+      }
+      if (erased == 0xFF) {
+         // Already erased value - skip command
+         skipped++;
+      }
+      else {
+         prepareSectors(address>>12, address>>12);
+         copyRamtoRom(address, data, blockSize, RESET_CLOCK_FREQ_kHz);
+      }
       data    += blockSize;
       address += blockSize;
       size    -= blockSize;
    }
+   if ((flashData->flags&DO_RECORD_COUNTERS) != 0) {
+      flashData->counters.programSkipped += skipped;
+   }
    flashData->flags &= ~DO_PROGRAM_RANGE;
 }
 
+/**
+ * Program a range of flash with a repeated pattern (DO_FILL_RANGE)
+ *
+ * The pattern is expanded into the buffer at dataAddress (which must hold at least
+ * FILL_CHUNK_SIZE bytes) and programmed repeatedly using programRange() so no data
+ * is transferred from the host.  fillPattern[0] is programmed at the start of the range.
+ *
+ * @param flashData Pointer to flash programming information
+ */
+void fillRange(FlashData_t *flashData) {
+   uint32_t        *buffer       = (uint32_t *)flashData->dataAddress;
+   uint32_t         startAddress = flashData->address;
+   uint32_t         size         = flashData->dataSize;
+   int              index;
+
+   if ((flashData->flags&DO_FILL_RANGE) == 0) {
+      return;
+   }
+   if ((size&(FILL_CHUNK_SIZE-1)) != 0) {
+      // IAP only programs whole blocks
+      setErrorCode(COUNT_ERROR);
+   }
+   for (index=0; index<FILL_CHUNK_SIZE/4; index++) {
+      buffer[index] = flashData->fillPattern[index&1];
+   }
+   while (flashData->address < startAddress+size) {
+      flashData->dataSize = startAddress+size-flashData->address;
+      if (flashData->dataSize > FILL_CHUNK_SIZE) {
+         flashData->dataSize = FILL_CHUNK_SIZE;
+      }
+      flashData->flags |= DO_PROGRAM_RANGE;
+      programRange(flashData);
+      flashData->address += FILL_CHUNK_SIZE;
+   }
+   flashData->address     = startAddress;
+   flashData->dataSize    = size;
+   flashData->flags      &= ~DO_FILL_RANGE;
+}
+
+/*==========================================================================================================
+ * Block compare kernels
+ *
+ * These scan flash a block of words at a time using LDM and reduce each block to a single
+ * test-and-branch.  They only locate the first failing block - the caller re-scans from
+ * there a word at a time to find the failing location and to handle any partial block.
+ *
+ *   Cortex-M3/M4 - 8 words per block
+ *   Cortex-M0    - 4 words per block
+ *
+ * Note: GCC assumes divided syntax for Thumb-1 inline assembly so unified syntax is
+ *       selected explicitly.
+ */
+#if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__)
+#define COMPARE_BLOCK_WORDS (8)
+#else
+#define COMPARE_BLOCK_WORDS (4)
+#endif
+
+/**
+ * Round a range down to a whole number of compare blocks
+ *
+ * @param address    Start of range
+ * @param endAddress End of range (exclusive)
+ *
+ * @return End of last whole block within the range
+ */
+static inline const uint32_t *blockEnd(const uint32_t *address, const uint32_t *endAddress) {
+   return address + ((endAddress-address) & ~(COMPARE_BLOCK_WORDS-1));
+}
+
+/**
+ * Find first block that is not blank (=0xFFFFFFFF)
+ *
+ * @param address    Start of range (word aligned)
+ * @param endAddress End of range (exclusive, whole number of blocks)
+ *
+ * @return Start of first block that is not blank or endAddress if all blank
+ */
+__attribute__((naked))
+const uint32_t *findNotBlankBlock(const uint32_t *address, const uint32_t *endAddress) {
+#if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__)
+   __asm__ volatile (
+         "   .syntax unified                 \n"
+         "   push  {r4-r8}                   \n"
+         "1: cmp   r0,r1                     \n"
+         "   bhs   2f                        \n"
+         "   ldmia r0!,{r2-r8,r12}           \n" // 8 words
+         "   and   r2,r2,r3                  \n"
+         "   and   r4,r4,r5                  \n"
+         "   and   r6,r6,r7                  \n"
+         "   and   r8,r8,r12                 \n"
+         "   and   r2,r2,r4                  \n"
+         "   and   r6,r6,r8                  \n"
+         "   and   r2,r2,r6                  \n"
+         "   adds  r2,r2,#1                  \n" // 0xFFFFFFFF => 0
+         "   beq   1b                        \n"
+         "   subs  r0,r0,#32                 \n" // Back to start of failing block
+         "2: pop   {r4-r8}                   \n"
+         "   bx    lr                        \n"
+   );
+#else
+   __asm__ volatile (
+         "   .syntax unified                 \n"
+         "   push  {r4,r5}                   \n"
+         "1: cmp   r0,r1                     \n"
+         "   bhs   2f                        \n"
+         "   ldmia r0!,{r2-r5}               \n" // 4 words
+         "   ands  r2,r3                     \n"
+         "   ands  r4,r5                     \n"
+         "   ands  r2,r4                     \n"
+         "   adds  r2,#1                     \n" // 0xFFFFFFFF => 0
+         "   beq   1b                        \n"
+         "   subs  r0,#16                    \n" // Back to start of failing block
+         "2: pop   {r4,r5}                   \n"
+         "   bx    lr                        \n"
+   );
+#endif
+}
+
+/**
+ * Find first block that differs from buffer
+ *
+ * @param address    Start of range (word aligned)
+ * @param endAddress End of range (exclusive, whole number of blocks)
+ * @param data       Data to compare against (word aligned)
+ *
+ * @return Start of first block that differs or endAddress if all match
+ */
+__attribute__((naked))
+const uint32_t *findMismatchBlock(const uint32_t *address, const uint32_t *endAddress, const uint32_t *data) {
+#if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__)
+   __asm__ volatile (
+         "   .syntax unified                 \n"
+         "   push  {r4-r10}                  \n"
+         "1: cmp   r0,r1                     \n"
+         "   bhs   2f                        \n"
+         "   ldmia r0!,{r3-r6}               \n" // 1st 4 words
+         "   ldmia r2!,{r7-r10}              \n"
+         "   eor   r3,r3,r7                  \n"
+         "   eor   r4,r4,r8                  \n"
+         "   eor   r5,r5,r9                  \n"
+         "   eor   r6,r6,r10                 \n"
+         "   orr   r3,r3,r4                  \n"
+         "   orr   r5,r5,r6                  \n"
+         "   orr   r12,r3,r5                 \n"
+         "   ldmia r0!,{r3-r6}               \n" // 2nd 4 words
+         "   ldmia r2!,{r7-r10}              \n"
+         "   eor   r3,r3,r7                  \n"
+         "   eor   r4,r4,r8                  \n"
+         "   eor   r5,r5,r9                  \n"
+         "   eor   r6,r6,r10                 \n"
+         "   orr   r3,r3,r4                  \n"
+         "   orr   r5,r5,r6                  \n"
+         "   orr   r3,r3,r5                  \n"
+         "   orrs  r3,r3,r12                 \n"
+         "   beq   1b                        \n"
+         "   subs  r0,r0,#32                 \n" // Back to start of failing block
+         "2: pop   {r4-r10}                  \n"
+         "   bx    lr                        \n"
+   );
+#else
+   __asm__ volatile (
+         "   .syntax unified                 \n"
+         "   push  {r4-r7}                   \n"
+         "   mov   r12,r1                    \n" // End address
+         "1: cmp   r0,r12                    \n"
+         "   bhs   2f                        \n"
+         "   ldmia r0!,{r3-r6}               \n" // 4 words
+         "   ldmia r2!,{r1,r7}               \n"
+         "   eors  r3,r1                     \n"
+         "   eors  r4,r7                     \n"
+         "   ldmia r2!,{r1,r7}               \n"
+         "   eors  r5,r1                     \n"
+         "   eors  r6,r7                     \n"
+         "   orrs  r3,r4                     \n"
+         "   orrs  r5,r6                     \n"
+         "   orrs  r3,r5                     \n"
+         "   beq   1b                        \n"
+         "   subs  r0,#16                    \n" // Back to start of failing block
+         "2: pop   {r4-r7}                   \n"
+         "   bx    lr                        \n"
+   );
+#endif
+}
+
 /*
  * Verify a range of flash against buffer
  *
@@ -404,6 +795,12 @@ void verifyRange(FlashData_t *flashData) {
    if ((flashData->flags&DO_VERIFY_RANGE) == 0) {
       return;
    }
+   // Skip matching blocks quickly - remainder is checked a word at a time
+   if ((((uint32_t)address|(uint32_t)data)&3) == 0) {
+      const uint32_t *blockAddress = findMismatchBlock(address, blockEnd(address, endAddress), data);
+      data    += blockAddress-address;
+      address  = (uint32_t *)blockAddress;
+   }
    // Verify bytes
    while (address<endAddress) {
       if (*address++ != *data++) {
@@ -450,6 +847,11 @@ void blankCheckRange(FlashData_t *flashData) {
    if ((flashData->flags&DO_BLANK_CHECK_RANGE) == 0) {
       return;
    }
+   // Skip blank blocks quickly - remainder is checked a word at a time
+   if ((address&3) == 0) {
+      address = (uint32_t)findNotBlankBlock((const uint32_t *)address,
+                                            blockEnd((const uint32_t *)address, (const uint32_t *)endAddress));
+   }
    while (address < endAddress) {
       if (*(uint32_t *)address != 0xFFFFFFFFUL) {
          setErrorCode(SECTOR_NOT_BLANK);
@@ -478,11 +880,17 @@ void entry(void) {
    // Handle on programming data
    FlashData_t *flashData = gFlashProgramHeader.flashData;
 
+   initCounters(flashData);
    initFlash(flashData);
+   startPhase(flashData, &flashData->counters.eraseTicks);
    eraseFlashBlock(flashData);
    eraseRange(flashData);
+   startPhase(flashData, &flashData->counters.blankCheckTicks);
    blankCheckRange(flashData);
+   startPhase(flashData, &flashData->counters.programTicks);
    programRange(flashData);
+   fillRange(flashData);
+   startPhase(flashData, &flashData->counters.verifyTicks);
    verifyRange(flashData);
 
 #ifndef DEBUG_BUILD
@@ -509,6 +917,43 @@ void asm_entry(void) {
 #endif
 }
 
+/**
+ * Confirm image is intact
+ *
+ * Calculates CRC-32 of the code and constants [__checkStart, __checkEnd) and compares
+ * it with gFlashProgramHeader.buildHash set by the host when the image was loaded.
+ * The host uses this to re-use an image still resident in RAM instead of loading it again.
+ * Nothing outside this function is used so a damaged image is reported rather than executed.
+ */
+void selfCheck(void) {
+   FlashData_t   *flashData = gFlashProgramHeader.flashData;
+   const uint8_t *ptr       = (const uint8_t *)__checkStart;
+   uint32_t       crc       = 0xFFFFFFFFUL;
+
+   while (ptr < (const uint8_t *)__checkEnd) {
+      crc ^= *ptr++;
+      for (int bit=0; bit<8; bit++) {
+         crc = (crc>>1)^(0xEDB88320UL&(0-(crc&1)));
+      }
+   }
+   flashData->errorCode = (~crc == gFlashProgramHeader.buildHash)?CMD_SUCCESS:COMPARE_ERROR;
+   flashData->flags    |= IS_COMPLETE;
+   for(;;) {
+      __asm__("bkpt  0");
+   }
+}
+
+/**
+ * Low level entry point for self-check
+ */
+__attribute__((naked))
+void asm_selfCheck(void) {
+   __asm__ (
+         "mov   r0,%[stacktop]\n\t"
+         "mov   sp,r0\n\t"
+         "b     selfCheck\n\t"::[stacktop] "r" (__stacktop));
+}
+
 #ifndef DEBUG_BUILD
 void asm_testApp(void) {
    for(;;) {
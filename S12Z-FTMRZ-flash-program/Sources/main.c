@@ -1,6 +1,8 @@
 //=======================================================================================
 // History
 //---------------------------------------------------------------------------------------
+// 19 Oct 2026 - Verify handles full 32-bit size, FCCOB written as words
+// 19 Oct 2026 - Added EEPROM programming & EEPROM update mode (DO_UPDATE_EEPROM)
 // 16 Apr 2014 - Added disabling Flash cache
 //=======================================================================================
 
@@ -82,6 +84,9 @@ typedef struct {
 #define DO_VERIFY_RANGE       (1<<5) // Verify range
 #define DO_PARTITION_FLEXNVM  (1<<7) // Program FlexNVM DFLASH/EEPROM partitioning
 #define DO_TIMING_LOOP        (1<<8) // Counting loop to determine clock speed
+#define DO_FILL_RANGE         (1<<11) // Program range with FlashData_t.fillPattern (no data transferred)
+#define DO_UPDATE_EEPROM      (1<<13) // Program EEPROM range erasing sectors only when necessary
+#define DO_RECORD_COUNTERS    (1<<14) // Record FlashData_t.programSkipped
 
 #define IS_COMPLETE           (1UL<<15)
                              
@@ -94,7 +99,10 @@ typedef struct {
 #define CAP_UNLOCK_FLASH       (1<<6)
 #define CAP_PARTITION_FLEXNVM  (1<<7)
 #define CAP_TIMING             (1<<8)
+#define CAP_FILL_RANGE         (1<<9)
+#define CAP_UPDATE_EEPROM      (1<<13)
 
+#define CAP_HEADER_V2          (1<<10) // Indicates FlashProgramHeader_t.info is valid
 #define CAP_DSC_OVERLAY        (1<<11) // Indicates DSC code in pMEM overlays xRAM
 #define CAP_DATA_FIXED         (1<<12) // Indicates TargetFlashDataHeader is at fixed address
                                
@@ -102,6 +110,10 @@ typedef struct {
 
 #define ADDRESS_LINEAR (1UL<<31) // Indicate address is linear
 #define ADDRESS_EEPROM (1UL<<30) // Indicate address lies within EEPROM
+#define ADDRESS_MASK   (0x00FFFFFFUL) // Physical (24-bit) address
+
+// Largest EEPROM sector handled by DO_UPDATE_EEPROM
+#define MAX_EEPROM_SECTOR_SIZE (4)
 
 // These error numbers are just for debugging
 typedef enum {
@@ -133,15 +145,50 @@ typedef struct {
    uint32_t                  address;           // Memory address being accessed
    uint32_t                  dataSize;          // Size of memory range being accessed
    uint32_t                  dataAddress;       // Pointer to data to program
+   uint32_t                  programSkipped;    // Program commands skipped as data was all erased value (only if DO_RECORD_COUNTERS)
+   uint32_t                  fillPattern[2];    // Pattern repeated over range (only if DO_FILL_RANGE)
 } FlashData_t;
 
+//==========================================================================================================
+// Information records (CAP_HEADER_V2)
+//
+// FlashProgramHeader_t.info points to a list of tag/length/value records terminated by INFO_END.
+// Values are in target byte order.  Records with unknown tags should be skipped using length.
+//
+#define HEADER_VERSION       (2)
+
+#define INFO_END             (0) // End of list
+#define INFO_VERSION         (1) // Header version (HEADER_VERSION)
+#define INFO_PHRASE_SIZE     (2) // Minimum program unit (bytes)
+#define INFO_SECTOR_SIZE     (3) // Minimum erase unit (bytes)
+#define INFO_BUFFER_ADDRESS  (4) // First free location after image (suitable for data buffer)
+#define INFO_BUFFER_SIZE     (5) // Largest dataSize accepted by a single call (bytes)
+#define INFO_OPERATIONS      (6) // Supported operations (CAP_xxx mask)
+#define INFO_CLOCK           (7) // Clock requirement (INFO_CLOCK_xxx or assumed bus clock in kHz)
+#define INFO_ENDIAN          (8) // Byte order (INFO_ENDIAN_xxx)
+#define INFO_ADDRESS_UNIT    (9) // Size of addressable unit (bytes)
+
+#define INFO_CLOCK_NONE      (0)            // Flash controller needs no clock set-up
+#define INFO_CLOCK_FREQUENCY (0xFFFFFFFFUL) // Flash clock divider is calculated from flashData->frequency
+#define INFO_CLOCK_HOST      (0xFFFFFFFEUL) // Flash clock divider must be set by host
+
+#define INFO_ENDIAN_LITTLE   (0)
+#define INFO_ENDIAN_BIG      (1)
+
+//! Information record
+typedef struct {
+   uint16_t         tag;               // Type of record (INFO_xxx)
+   uint16_t         length;            // Size of value (bytes)
+   uint32_t         value;             // Value
+} FlashInfoRecord_t;
+
 //! Describe the flash programming code
 typedef struct {
    uint32_t         loadAddress;       // Address where to load this image
    uint32_t         entry;             // Pointer to entry routine
    uint32_t         capabilities;      // Capabilities of routine
    uint32_t         watchdog;
-   uint32_t         reserved2;
+   uint32_t         info;              // Pointer to information records (CAP_HEADER_V2)
    uint32_t         flashData;         // Pointer to information about operation
 } FlashProgramHeader_t;
 
@@ -149,19 +196,36 @@ typedef struct {
 
 void entry(void);
 
+#define CAPABILITIES (CAP_BLANK_CHECK_RANGE|CAP_ERASE_RANGE|CAP_ERASE_BLOCK|CAP_PROGRAM_RANGE|\
+                      CAP_VERIFY_RANGE|CAP_UPDATE_EEPROM|CAP_HEADER_V2|CAP_FILL_RANGE)
+
+//! Information records describing this routine
+//!
+const FlashInfoRecord_t flashInfo[] = {
+     {INFO_VERSION,        4, HEADER_VERSION},
+     {INFO_PHRASE_SIZE,    4, 8},
+     {INFO_SECTOR_SIZE,    4, 512},
+     {INFO_BUFFER_SIZE,    4, 0xFFFFFFFFUL},
+     {INFO_OPERATIONS,     4, CAPABILITIES},
+     {INFO_CLOCK,          4, 16000},
+     {INFO_ENDIAN,         4, INFO_ENDIAN_BIG},
+     {INFO_ADDRESS_UNIT,   4, 1},
+     {INFO_END,            0, 0},
+};
+
 //! Flash programming command table
 //!
 volatile const FlashProgramHeader_t gFlashProgramHeader = {
      /* loadAddress  */             0x001000,
      /* entry        */             0x001018,
-     /* capabilities */             CAP_BLANK_CHECK_RANGE|CAP_ERASE_RANGE|CAP_ERASE_BLOCK|CAP_PROGRAM_RANGE|CAP_VERIFY_RANGE,
+     /* capabilities */             CAPABILITIES,
      /* Reserved1    */             0,
-     /* Reserved2    */             0,
+     /* info         */             (uint32_t)flashInfo,
      /* flashData    */             0,
 };
 
 //! Some stack space
-uint8_t __stacktop[41]; // adjust to make image even size
+uint8_t __stacktop[61]; // adjust to make image even size
 
 //! Low level entry point
 //! 
@@ -169,7 +233,7 @@ void asm_entry(void) {
    
 #ifndef DEBUG
    __asm {
-      LD S, #__stacktop+40-1     /* initialize SP */
+      LD S, #__stacktop+60-1     /* initialize SP */
    }
 #endif
    entry();
@@ -179,6 +243,10 @@ void setErrorCode(uint16_t errorCode);// __attribute__ ((noreturn));
 void initFlash(FlashData_t *flashData);
 void eraseBlock(FlashData_t *flashData);
 void programRange(FlashData_t *flashData);
+void fillRange(FlashData_t *flashData);
+void programEeprom(volatile FlashController *controller, uint32_t address, const uint8_t *data, uint8_t numBytes);
+void programEepromRange(FlashData_t *flashData);
+void updateEepromRange(FlashData_t *flashData);
 void verifyRange(FlashData_t *flashData);
 void eraseRange(FlashData_t *flashData);
 void blankCheckRange(FlashData_t *flashData);
@@ -264,6 +332,129 @@ void eraseBlock(FlashData_t *flashData) {
    flashData->flags &= ~DO_ERASE_BLOCK;
 }
 
+//! Program 1 to 4 EEPROM bytes
+//!
+//! @param controller - Flash controller
+//! @param address    - EEPROM address
+//! @param data       - Bytes to program
+//! @param numBytes   - Number of bytes to program (1-4)
+//!
+void programEeprom(volatile FlashController *controller, uint32_t address, const uint8_t *data, uint8_t numBytes) {
+   uint8_t index;
+   
+   // Write command & address
+   controller->fccob[0].high = FCMD_PROGRAM_EEPROM; 
+   controller->fccob[0].low  = (uint8_t)(address>>16);
+   controller->fccob[1].high = (uint8_t)(address>>8);
+   controller->fccob[1].low  = (uint8_t)(address);
+   // Bytes in fccob[2..5].low
+   for (index=0; index<numBytes; index++) {
+      controller->fccob[2+index].low = *data++;
+   }
+   // Write number of parameters
+   controller->fccobix = 1+numBytes; 
+   // Execute command
+   executeCommand(controller);
+}
+
+//! Program a range of EEPROM from buffer
+//!
+//! Range is assumed to have been erased
+//!
+void programEepromRange(FlashData_t *flashData) {
+   volatile FlashController *controller = (volatile FlashController *)flashData->controller;
+   uint32_t         address    = flashData->address&ADDRESS_MASK;
+   uint32_t         size       = flashData->dataSize;
+   const uint8_t   *data       = (const uint8_t *)flashData->dataAddress;
+   
+   // Program 1 to 4 EEPROM bytes
+   while (size > 0) {
+      uint8_t numBytes = MAX_EEPROM_SECTOR_SIZE;
+      if (size < numBytes) {
+         numBytes = (uint8_t)size;
+      }
+      programEeprom(controller, address, data, numBytes);
+      address += numBytes;
+      data    += numBytes;
+      size    -= numBytes;
+   }
+}
+
+//! Update a range of EEPROM from buffer
+//!
+//! Each EEPROM sector touched by the range is compared with the new contents:
+//!   - Unchanged sectors are skipped
+//!   - Sectors only requiring 1->0 bit changes have just the changed bytes programmed
+//!   - Otherwise the sector is erased and re-programmed
+//!
+//! Bytes of a partial sector lying outside the range are preserved.
+//! Eliminates the need for a separate DO_ERASE_RANGE pass.
+//!
+void updateEepromRange(FlashData_t *flashData) {
+   volatile FlashController *controller = (volatile FlashController *)flashData->controller;
+   uint32_t         address    = flashData->address&ADDRESS_MASK;
+   uint32_t         size       = flashData->dataSize;
+   const uint8_t   *data       = (const uint8_t *)flashData->dataAddress;
+   uint8_t          sectorSize = (uint8_t)flashData->sectorSize;
+   uint8_t          sector[MAX_EEPROM_SECTOR_SIZE];
+   
+   // Sector must be a small power of 2
+   if ((sectorSize == 0) || (flashData->sectorSize > MAX_EEPROM_SECTOR_SIZE) ||
+       ((sectorSize & (sectorSize-1)) != 0)) {
+      setErrorCode(FLASH_ERR_ILLEGAL_PARAMS);
+   }
+   while (size > 0) {
+      uint32_t       sectorAddress = address & ~(uint32_t)(sectorSize-1);
+      const uint8_t *eeprom        = (const uint8_t *)sectorAddress;
+      uint8_t        eraseNeeded   = 0;
+      uint8_t        index;
+
+      // Merge new data with current sector contents
+      for (index=0; index<sectorSize; index++) {
+         uint8_t current = eeprom[index];
+         uint8_t value   = current;
+         if ((size > 0) && ((sectorAddress+index) == address)) {
+            value = *data++;
+            address++;
+            size--;
+         }
+         sector[index] = value;
+         if (value != current) {
+            if ((value & (uint8_t)~current) != 0) {
+               // A bit has to change 0->1
+               eraseNeeded = 1;
+            }
+         }
+      }
+      if (eraseNeeded) {
+         // Erase sector & re-program entire sector
+         controller->fccob[0].high = FCMD_ERASE_EEPROM_SECTOR; 
+         controller->fccob[0].low  = (uint8_t)(sectorAddress>>16);
+         controller->fccob[1].high = (uint8_t)(sectorAddress>>8);
+         controller->fccob[1].low  = (uint8_t)(sectorAddress);
+         controller->fccobix = 1;
+         executeCommand(controller);
+         programEeprom(controller, sectorAddress, sector, sectorSize);
+      }
+      else {
+         // Only program the runs of bytes that change - unchanged bytes are not re-programmed
+         index = 0;
+         while (index < sectorSize) {
+            uint8_t start;
+            if (sector[index] == eeprom[index]) {
+               index++;
+               continue;
+            }
+            start = index;
+            do {
+               index++;
+            } while ((index < sectorSize) && (sector[index] != eeprom[index]));
+            programEeprom(controller, sectorAddress+start, sector+start, (uint8_t)(index-start));
+         }
+      }
+   }
+}
+
 //! Program a range from buffer
 //!
 //! Returns an error if the security location is to be programmed
@@ -273,64 +464,121 @@ void programRange(FlashData_t *flashData) {
    volatile FlashController *controller = (volatile FlashController *)flashData->controller;
    uint32_t         address    = flashData->address;
    uint32_t         endAddress = flashData->address+flashData->dataSize;
-   const uint32_t  *data       = (uint32_t*)flashData->dataAddress;
+   const uint16_t  *data       = (uint16_t*)flashData->dataAddress;
+   volatile uint16_t *fccob    = (volatile uint16_t *)controller->fccob;
+   uint32_t         skipped    = 0;
    
    if ((flashData->flags&DO_PROGRAM_RANGE) == 0) {
       return;
    }
+   if ((flashData->address&ADDRESS_EEPROM) != 0) {
+      // Clear any existing errors
+      controller->fstat   = FSTAT_ACCERR|FSTAT_FPVIOL;
+      if ((flashData->flags&DO_UPDATE_EEPROM) != 0) {
+         updateEepromRange(flashData);
+      }
+      else {
+         programEepromRange(flashData);
+      }
+      flashData->flags &= ~(DO_PROGRAM_RANGE|DO_UPDATE_EEPROM);
+      return;
+   }
    // Clear any existing errors
    controller->fstat   = FSTAT_ACCERR|FSTAT_FPVIOL;
    
-   // Program 1 to 2 Flash phrases (1 phrase = 4 bytes)
+   // Program Flash phrases (1 phrase = 8 bytes)
    while (address < endAddress) { // Exclusive end address
-      uint32_t dataValue;
-      
+      if ((data[0]&data[1]&data[2]&data[3]) == 0xFFFF) {
+         // Already erased value - skip command
+         skipped++;
+         data    += 4;
+         address += 8;
+         continue;
+      }
       // Write command & address
-      controller->fccob[0].high = FCMD_PROGRAM_FLASH; 
-      controller->fccob[0].low  = (uint8_t)(address>>16);
-      controller->fccob[1].high = (uint8_t)(address>>8);
-      controller->fccob[1].low  = (uint8_t)(address);
-      // 1st data phrase
-      dataValue  = *data++; 
-      address   += 4;
-      controller->fccob[2].high  = (uint8_t)(dataValue>>24);
-      controller->fccob[2].low   = (uint8_t)(dataValue>>16);
-      controller->fccob[3].high  = (uint8_t)(dataValue>>8);
-      controller->fccob[3].low   = (uint8_t)(dataValue);
-      // 2nd data phrase
-      dataValue  = *data++; 
-      address   += 4;
-      controller->fccob[4].high  = (uint8_t)(dataValue>>24);
-      controller->fccob[4].low   = (uint8_t)(dataValue>>16);
-      controller->fccob[5].high  = (uint8_t)(dataValue>>8);
-      controller->fccob[5].low   = (uint8_t)(dataValue);
+      fccob[0] = (FCMD_PROGRAM_FLASH<<8)|(uint8_t)(address>>16);
+      fccob[1] = (uint16_t)address;
+      // Phrase data (big-endian words)
+      fccob[2] = *data++;
+      fccob[3] = *data++;
+      fccob[4] = *data++;
+      fccob[5] = *data++;
+      address += 8;
       // Write number of parameters
       controller->fccobix = 5; 
       // Execute command
       executeCommand(controller);
    }
+   if ((flashData->flags&DO_RECORD_COUNTERS) != 0) {
+      flashData->programSkipped += skipped;
+   }
    flashData->flags &= ~DO_PROGRAM_RANGE;
 }
 
+//! Program a range of flash with a repeated pattern (DO_FILL_RANGE)
+//!
+//! fillPattern[] (one phrase) is programmed repeatedly using programRange()
+//! so no data is transferred from the host.
+//! fillPattern[0] is programmed at the start of the range.
+//! DO_UPDATE_EEPROM applies to every phrase (programRange() clears it after each call).
+//!
+void fillRange(FlashData_t *flashData) {
+   uint32_t startAddress = flashData->address;
+   uint32_t size         = flashData->dataSize;
+   uint32_t data         = flashData->dataAddress;
+   uint32_t update       = flashData->flags&DO_UPDATE_EEPROM;
+
+   if ((flashData->flags&DO_FILL_RANGE) == 0) {
+      return;
+   }
+   if (((startAddress&ADDRESS_EEPROM) == 0) && ((size&0x07) != 0)) {
+      // Only whole flash phrases (8 bytes) are programmed
+      setErrorCode(FLASH_ERR_ILLEGAL_PARAMS);
+   }
+   flashData->dataAddress = (uint32_t)flashData->fillPattern;
+   while (flashData->address < startAddress+size) {
+      flashData->dataSize = startAddress+size-flashData->address;
+      if (flashData->dataSize > sizeof(flashData->fillPattern)) {
+         flashData->dataSize = sizeof(flashData->fillPattern);
+      }
+      flashData->flags |= DO_PROGRAM_RANGE|update;
+      programRange(flashData);
+      flashData->address += sizeof(flashData->fillPattern);
+   }
+   flashData->address      = startAddress;
+   flashData->dataSize     = size;
+   flashData->dataAddress  = data;
+   flashData->flags       &= ~(DO_FILL_RANGE|DO_UPDATE_EEPROM);
+}
+
 //! Verify a range of flash against buffer
 //!
+//! Compares longwords with a byte-wise tail
+//!
 void verifyRange(FlashData_t *flashData) {
-   const uint8_t *address = (uint8_t *)flashData->address;
-   const uint8_t *data    = (uint8_t *)flashData->dataAddress;
-   uint8_t        size    = flashData->dataSize;
+   const uint32_t *address = (uint32_t *)(flashData->address&ADDRESS_MASK);
+   const uint32_t *data    = (uint32_t *)flashData->dataAddress;
+   uint32_t        size    = flashData->dataSize;
    
    if ((flashData->flags&DO_VERIFY_RANGE) == 0) {
       return;
    }
-   // Verify bytes
-   while (size>0) {
+   // Verify longwords
+   while (size >= sizeof(*address)) {
       if (*address++ != *data++) {
-         // Record failure address
-//         flashData->controller = (FlashController*)(address);
          setErrorCode(FLASH_ERR_VERIFY_FAILED);
       }
       size -= sizeof(*address);
    }
+   // Verify trailing bytes
+   while (size > 0) {
+      if (*(const uint8_t *)address != *(const uint8_t *)data) {
+         setErrorCode(FLASH_ERR_VERIFY_FAILED);
+      }
+      address = (const uint32_t *)((const uint8_t *)address+1);
+      data    = (const uint32_t *)((const uint8_t *)data+1);
+      size   -= sizeof(uint8_t);
+   }
    flashData->flags &= ~DO_VERIFY_RANGE;
 }
 
@@ -341,6 +589,7 @@ void eraseRange(FlashData_t *flashData) {
    uint32_t address     = flashData->address;
    uint32_t endAddress  = address + flashData->dataSize - 1; // Inclusive
    uint32_t pageMask    = flashData->sectorSize-1U;
+   uint8_t  eraseCommand;
    
    if ((flashData->flags&DO_ERASE_RANGE) == 0) {
       return;
@@ -355,13 +604,19 @@ void eraseRange(FlashData_t *flashData) {
    // Round end address to end of block (inclusive)
    endAddress |= pageMask;
    
+   if ((flashData->address&ADDRESS_EEPROM) != 0) {
+      eraseCommand = FCMD_ERASE_EEPROM_SECTOR;
+   }
+   else {
+      eraseCommand = FCMD_ERASE_FLASH_SECTOR;
+   }
    // Clear any existing errors
    controller->fstat   = FSTAT_ACCERR|FSTAT_FPVIOL;
 
    // Erase each sector
    while (address <= endAddress) { // Inclusive range!
       // Write command
-      controller->fccob[0].high = FCMD_ERASE_FLASH_SECTOR; 
+      controller->fccob[0].high = eraseCommand; 
       controller->fccob[0].low  = (uint8_t)(address>>16);
       controller->fccob[1].high = (uint8_t)(address>>8);
       controller->fccob[1].low  = (uint8_t)(address);
@@ -418,11 +673,15 @@ void entry(void) {
    // No errors so far
    flashData->errorCode = FLASH_ERR_OK;
    
+   if ((flashData->flags&DO_RECORD_COUNTERS) != 0) {
+      flashData->programSkipped = 0;
+   }
    initFlash(flashData);
    eraseBlock(flashData);
    eraseRange(flashData);
    blankCheckRange(flashData);
    programRange(flashData);
+   fillRange(flashData);
    verifyRange(flashData);
    
 #ifndef DEBUG
@@ -92,14 +92,17 @@ typedef struct {
 #define DO_VERIFY_RANGE       (1<<5) // Verify range
 #define DO_PARTITION_FLEXNVM  (1<<7) // Not used
 #define DO_TIMING_LOOP        (1<<8) // Counting loop to determine clock speed
+#define DO_FILL_RANGE         (1<<11) // Program range with FlashData_t.fillPattern (no data transferred)
 #define DO_UNLOCK_FLASH       (1<<9) // Unlock flash with default security options  (+mass erase if needed)
 #define DO_LOCK_FLASH         (1<<10)// Lock flash with default security options
+#define DO_RECORD_COUNTERS    (1<<14)// Record performance counters in FlashData_t
 
 // 9 - 15 reserved
 // 16-23 target/family specific
 // Allows programming/erasing Option region, +DO_INIT_FLASH+DO_PROGRAM_RANGE+DO_ERASE_RANGE
 #define DO_MODIFY_OPTION      (1<<16) 
 // 24-29 reserved
+#define DO_COPY_RANGE         (1<<25) // Program range from FlashData_t.dataAddress in flash (copy on target)
 
 #define NEED_RESET            (1<<30)
 #define IS_COMPLETE           (1<<31)
@@ -113,7 +116,11 @@ typedef struct {
 #define CAP_UNLOCK_FLASH       (1<<6)
 #define CAP_PARTITION_FLEXNVM  (1<<7)
 #define CAP_TIMING             (1<<8)
+#define CAP_FILL_RANGE         (1<<9)
+#define CAP_RECORD_COUNTERS    (1<<14)
+#define CAP_COPY_RANGE         (1<<25)
 
+#define CAP_HEADER_V2          (1<<10) // Indicates FlashProgramHeader_t.info is valid
 #define CAP_DSC_OVERLAY        (1<<11) // Indicates DSC code in pMEM overlays xRAM
 #define CAP_DATA_FIXED         (1<<12) // Indicates TargetFlashDataHeader is at fixed address
                                
@@ -137,8 +144,23 @@ typedef enum {
      FLASH_ERR_UNKNOWN           = (13)  // Unspecified error
 } FlashDriverError_t;
 
+// Size of buffer programmed repeatedly by fillRange() (DO_FILL_RANGE)
+#define FILL_CHUNK_SIZE (32)
+
+// Size of buffer used to stage data by copyRange() (DO_COPY_RANGE)
+#define COPY_CHUNK_SIZE (32)
+
 typedef void (*EntryPoint_t)(void);
 #pragma pack(2)
+//! Performance counters (only written if DO_RECORD_COUNTERS)
+typedef struct {
+   uint32_t         eraseTicks;        // Core clock cycles spent erasing
+   uint32_t         blankCheckTicks;   // Core clock cycles spent blank checking
+   uint32_t         programTicks;      // Core clock cycles spent programming
+   uint32_t         verifyTicks;       // Core clock cycles spent verifying
+   uint32_t         programSkipped;    // Program commands skipped as data was all erased value
+} FlashCounters_t;
+
 // Describes a block to be programmed & result
 typedef struct {
    uint32_t         flags;             // Controls actions of routine
@@ -149,15 +171,50 @@ typedef struct {
    uint32_t         address;           // Memory address being accessed
    uint32_t         dataSize;          // Size of memory range being accessed
    const uint16_t  *dataAddress;       // Pointer to data to program
+   FlashCounters_t  counters;          // Performance counters (only if DO_RECORD_COUNTERS)
+   uint32_t         fillPattern[2];    // Pattern repeated over range (only if DO_FILL_RANGE)
 } FlashData_t;
 
+//==========================================================================================================
+// Information records (CAP_HEADER_V2)
+//
+// FlashProgramHeader_t.info points to a list of tag/length/value records terminated by INFO_END.
+// Values are in target byte order.  Records with unknown tags should be skipped using length.
+//
+#define HEADER_VERSION       (2)
+
+#define INFO_END             (0) // End of list
+#define INFO_VERSION         (1) // Header version (HEADER_VERSION)
+#define INFO_PHRASE_SIZE     (2) // Minimum program unit (bytes)
+#define INFO_SECTOR_SIZE     (3) // Minimum erase unit (bytes)
+#define INFO_BUFFER_ADDRESS  (4) // First free location after image (suitable for data buffer)
+#define INFO_BUFFER_SIZE     (5) // Largest dataSize accepted by a single call (bytes)
+#define INFO_OPERATIONS      (6) // Supported operations (CAP_xxx mask)
+#define INFO_CLOCK           (7) // Clock requirement (INFO_CLOCK_xxx or assumed bus clock in kHz)
+#define INFO_ENDIAN          (8) // Byte order (INFO_ENDIAN_xxx)
+#define INFO_ADDRESS_UNIT    (9) // Size of addressable unit (bytes)
+
+#define INFO_CLOCK_NONE      (0)            // Flash controller needs no clock set-up
+#define INFO_CLOCK_FREQUENCY (0xFFFFFFFFUL) // Flash clock divider is calculated from flashData->frequency
+#define INFO_CLOCK_HOST      (0xFFFFFFFEUL) // Flash clock divider must be set by host
+
+#define INFO_ENDIAN_LITTLE   (0)
+#define INFO_ENDIAN_BIG      (1)
+
+//! Information record
+typedef struct {
+   uint16_t         tag;               // Type of record (INFO_xxx)
+   uint16_t         length;            // Size of value (bytes)
+   uint32_t         value;             // Value
+} FlashInfoRecord_t;
+
 //! Describe the flash programming code
 typedef struct {
    uint32_t         loadAddress;       // Address where to load this image
    EntryPoint_t     entry;             // Pointer to entry routine
    uint32_t         capabilities;      // Capabilities of routine
    uint32_t         reserved1;
-   uint32_t         reserved2;
+   const FlashInfoRecord_t *info;      // Pointer to information records (CAP_HEADER_V2)
    FlashData_t     *flashData;         // Pointer to information about operation
 } FlashProgramHeader_t;
 
@@ -165,15 +222,41 @@ typedef struct {
 
 asm void asm_entry(void);
 
+#define CAPABILITIES (CAP_BLANK_CHECK_RANGE|CAP_ERASE_RANGE|CAP_ERASE_BLOCK|CAP_PROGRAM_RANGE|\
+                      CAP_VERIFY_RANGE|CAP_RECORD_COUNTERS|CAP_HEADER_V2|CAP_FILL_RANGE|\
+                      CAP_COPY_RANGE|CAP_DATA_FIXED)
+
+//! Fixed location of FlashData_t (CAP_DATA_FIXED) - placed after image by linker file
+//!
+#pragma define_section flashData ".flashData" far_abs RW
+__declspec(flashData) FlashData_t gFlashData;
+
+extern uint32_t __dataBuffer[];
+extern uint32_t __dataBufferSize[];
+
+//! Information records describing this routine
+//!
+const FlashInfoRecord_t flashInfo[] = {
+     {INFO_VERSION,        4, HEADER_VERSION},
+     {INFO_PHRASE_SIZE,    4, 2},
+     {INFO_BUFFER_ADDRESS, 4, (uint32_t)__dataBuffer},
+     {INFO_BUFFER_SIZE,    4, (uint32_t)__dataBufferSize},
+     {INFO_OPERATIONS,     4, CAPABILITIES},
+     {INFO_CLOCK,          4, INFO_CLOCK_NONE},
+     {INFO_ENDIAN,         4, INFO_ENDIAN_LITTLE},
+     {INFO_ADDRESS_UNIT,   4, 1},
+     {INFO_END,            0, 0},
+};
+
 //! Flash programming command table
 //!
 const FlashProgramHeader_t gFlashProgramHeader = {
      /* loadAddress  */ 0x20000000,        // load address of image
      /* entry        */ asm_entry,         // entry point for code
-     /* capabilities */ CAP_BLANK_CHECK_RANGE|CAP_ERASE_RANGE|CAP_ERASE_BLOCK|CAP_PROGRAM_RANGE|CAP_VERIFY_RANGE,
+     /* capabilities */ CAPABILITIES,
      /* Reserved1    */ 0,
-     /* Reserved2    */ 0,
-     /* flashData    */ NULL,
+     /* info         */ flashInfo,
+     /* flashData    */ &gFlashData,       // fixed location (CAP_DATA_FIXED)
 // Reserved for target specific use, values may be copied from XML
 // STM32F100xx - option default values
 //    RDP        USER                         DATA0 DATA1 WRP0  WRP1  WRP2  WRP3
@@ -182,12 +265,18 @@ const FlashProgramHeader_t gFlashProgramHeader = {
 };
 
 void setErrorCode(int errorCode);
+void initCounters(FlashData_t *flashData);
+void startPhase(FlashData_t *flashData, uint32_t *counter);
 void initFlash(FlashData_t *flashData);
 void eraseFlashBlock(FlashData_t *flashData);
 void programRange(FlashData_t *flashData);
+void fillRange(FlashData_t *flashData);
+void copyRange(FlashData_t *flashData);
 void verifyRange(FlashData_t *flashData);
 void eraseRange(FlashData_t *flashData);
 void blankCheckRange(FlashData_t *flashData);
+const uint32_t *findNotBlankBlock(const uint32_t *address, uint32_t numBlocks);
+const uint32_t *findMismatchBlock(const uint32_t *address, const uint32_t *data, uint32_t numBlocks);
 //int unlockFlash(FlashData_t *);
 //int lockFlash(FlashData_t *flashData);
 //asm void asmTimingLoop(void);
@@ -198,10 +287,59 @@ void isr_default(void);
 void testApp(void);
 asm void asm_testApp(void);
 
+//==========================================================================================================
+// Performance counters (DO_RECORD_COUNTERS)
+//
+//  Time spent in each phase is accumulated in core clock cycles using the DWT cycle counter
+//
+#define DEMCR            (*(volatile uint32_t *)0xE000EDFC)
+#define DEMCR_TRCENA     (1<<24)
+#define DWT_CTRL         (*(volatile uint32_t *)0xE0001000)
+#define DWT_CTRL_CYCCNTENA (1<<0)
+#define DWT_CYCCNT       (*(volatile uint32_t *)0xE0001004)
+
+static uint32_t *phaseCounter;   // Counter for phase in progress (NULL if none)
+static uint32_t  phaseStart;     // Cycle count when phase started
+
+//! Clear counters and start cycle counter if recording
+//!
+void initCounters(FlashData_t *flashData) {
+   phaseCounter = NULL;
+   if ((flashData->flags&DO_RECORD_COUNTERS) == 0) {
+      return;
+   }
+   flashData->counters.eraseTicks      = 0;
+   flashData->counters.blankCheckTicks = 0;
+   flashData->counters.programTicks    = 0;
+   flashData->counters.verifyTicks     = 0;
+   flashData->counters.programSkipped  = 0;
+   DEMCR    |= DEMCR_TRCENA;
+   DWT_CTRL |= DWT_CTRL_CYCCNTENA;
+}
+
+//! Close current phase and start timing a new one
+//!
+//! @param counter - counter to accumulate into (NULL to just close current phase)
+//!
+void startPhase(FlashData_t *flashData, uint32_t *counter) {
+   uint32_t now;
+
+   if ((flashData->flags&DO_RECORD_COUNTERS) == 0) {
+      return;
+   }
+   now = DWT_CYCCNT;
+   if (phaseCounter != NULL) {
+      *phaseCounter += now - phaseStart;
+   }
+   phaseCounter = counter;
+   phaseStart   = now;
+}
+
 //! Set error code to return to BDM & halt
 //!
 void setErrorCode(int errorCode) {
    FlashData_t *flashData = gFlashProgramHeader.flashData;
+   startPhase(flashData, NULL);
    flashData->errorCode   = (uint16_t)errorCode;
    flashData->flags      |= IS_COMPLETE; 
    asm {
@@ -267,6 +405,7 @@ void programRange(FlashData_t *flashData) {
    uint32_t         address    = flashData->address;
    const uint16_t       *data  = flashData->dataAddress;
    uint16_t numHalfWords       = flashData->dataSize/2;
+   uint32_t skipped            = 0;
    
    if ((flashData->flags&DO_PROGRAM_RANGE) == 0) {
       return;
@@ -282,16 +421,22 @@ void programRange(FlashData_t *flashData) {
       FLASH_CR = FLASH_CR_PG;
    }
    while (numHalfWords-- > 0) {
-      *(uint16_t *)address = *data;
-      while ((FLASH_SR & FLASH_SR_BSY) != 0) {
-      }
-      if ((FLASH_SR & FLASH_SR_PGERR) != 0) {
-         FLASH_CR = 0;
-         setErrorCode(FLASH_ERR_PROG_FAILED);
+      if ((*data == 0xFFFF) && ((flashData->flags&DO_MODIFY_OPTION) == 0)) {
+         // Already erased value - skip command (still checked below)
+         skipped++;
       }
-      if ((FLASH_SR & FLASH_SR_WRPRTERR) != 0) {
-         FLASH_CR = 0;
-         setErrorCode(FLASH_ERR_PROG_WPROT);
+      else {
+         *(uint16_t *)address = *data;
+         while ((FLASH_SR & FLASH_SR_BSY) != 0) {
+         }
+         if ((FLASH_SR & FLASH_SR_PGERR) != 0) {
+            FLASH_CR = 0;
+            setErrorCode(FLASH_ERR_PROG_FAILED);
+         }
+         if ((FLASH_SR & FLASH_SR_WRPRTERR) != 0) {
+            FLASH_CR = 0;
+            setErrorCode(FLASH_ERR_PROG_WPROT);
+         }
       }
       // Only try verify if not options 
       if (((flashData->flags&DO_MODIFY_OPTION) == 0) &&
@@ -303,9 +448,149 @@ void programRange(FlashData_t *flashData) {
       data++;
    }
    FLASH_CR = 0;   
+   if ((flashData->flags&DO_RECORD_COUNTERS) != 0) {
+      flashData->counters.programSkipped += skipped;
+   }
    flashData->flags &= ~DO_PROGRAM_RANGE;
 }
 
+//! Program a range of flash with a repeated pattern (DO_FILL_RANGE)
+//!
+//! The pattern is expanded into a small buffer which is programmed repeatedly
+//! using programRange() so no data is transferred from the host.
+//! fillPattern[0] is programmed at the start of the range.
+//!
+void fillRange(FlashData_t *flashData) {
+   uint32_t         buffer[FILL_CHUNK_SIZE/4];
+   uint32_t         startAddress = flashData->address;
+   uint32_t         size         = flashData->dataSize;
+   const uint16_t  *data         = flashData->dataAddress;
+   int              index;
+
+   if ((flashData->flags&DO_FILL_RANGE) == 0) {
+      return;
+   }
+   if ((size&0x01) != 0) {
+      // Only whole half-words are programmed
+      setErrorCode(FLASH_ERR_ILLEGAL_PARAMS);
+   }
+   for (index=0; index<FILL_CHUNK_SIZE/4; index++) {
+      buffer[index] = flashData->fillPattern[index&1];
+   }
+   flashData->dataAddress = (const uint16_t *)buffer;
+   while (flashData->address < startAddress+size) {
+      flashData->dataSize = startAddress+size-flashData->address;
+      if (flashData->dataSize > FILL_CHUNK_SIZE) {
+         flashData->dataSize = FILL_CHUNK_SIZE;
+      }
+      flashData->flags |= DO_PROGRAM_RANGE;
+      programRange(flashData);
+      flashData->address += FILL_CHUNK_SIZE;
+   }
+   flashData->address      = startAddress;
+   flashData->dataSize     = size;
+   flashData->dataAddress  = data;
+   flashData->flags       &= ~DO_FILL_RANGE;
+}
+
+//! Copy a range of flash to another range of flash (DO_COPY_RANGE)
+//!
+//! dataAddress is the source and may be in flash.  Data is staged through a small
+//! buffer so programRange() never reads flash while a command is in progress.
+//! If DO_ERASE_RANGE is also set the destination sectors are erased first.
+//! The source must not overlap the destination (or the sectors being erased).
+//! dataSize must be a whole number of half-words.
+//! dataAddress is left unchanged so DO_VERIFY_RANGE compares the copy against the source.
+//!
+void copyRange(FlashData_t *flashData) {
+   uint32_t         buffer[COPY_CHUNK_SIZE/4];
+   uint32_t         startAddress = flashData->address;
+   uint32_t         size         = flashData->dataSize;
+   const uint16_t  *data         = flashData->dataAddress;
+   const uint8_t   *source       = (const uint8_t *)data;
+   uint32_t         first        = startAddress;
+   uint32_t         last         = startAddress+size; // exclusive
+   uint32_t         index;
+
+   if ((flashData->flags&DO_COPY_RANGE) == 0) {
+      return;
+   }
+   if ((size&0x01) != 0) {
+      // Only whole half-words are programmed
+      setErrorCode(FLASH_ERR_ILLEGAL_PARAMS);
+   }
+   if ((flashData->flags&DO_ERASE_RANGE) != 0) {
+      // Source must survive erasing whole destination sectors
+      first &= ~(flashData->sectorSize-1U);
+      last   = (last+flashData->sectorSize-1U)&~(flashData->sectorSize-1U);
+   }
+   if (((uint32_t)source < last) && (first < (uint32_t)source+size)) {
+      setErrorCode(FLASH_ERR_ILLEGAL_PARAMS);
+   }
+   // Erase ahead of copy
+   eraseRange(flashData);
+
+   flashData->dataAddress = (const uint16_t *)buffer;
+   while (flashData->address < startAddress+size) {
+      flashData->dataSize = startAddress+size-flashData->address;
+      if (flashData->dataSize > COPY_CHUNK_SIZE) {
+         flashData->dataSize = COPY_CHUNK_SIZE;
+      }
+      for (index=0; index<flashData->dataSize; index++) {
+         ((uint8_t *)buffer)[index] = *source++;
+      }
+      flashData->flags |= DO_PROGRAM_RANGE;
+      programRange(flashData);
+      flashData->address += COPY_CHUNK_SIZE;
+   }
+   flashData->address     = startAddress;
+   flashData->dataSize    = size;
+   flashData->dataAddress = data;
+   flashData->flags      &= ~DO_COPY_RANGE;
+}
+
+//! Number of words in each block scanned by the block compare loops
+#define COMPARE_BLOCK_WORDS (4)
+
+//! Find first block that is not blank (=0xFFFFFFFF)
+//!
+//! Each block is reduced to a single test-and-branch so the compiler can use multi-word
+//! loads.  The caller re-scans from the returned block to locate the failing element.
+//!
+//! @param address    Start of range (word aligned)
+//! @param numBlocks  Number of blocks to check
+//!
+//! @return Start of first block that is not blank or end of range if all blank
+//!
+const uint32_t *findNotBlankBlock(const uint32_t *address, uint32_t numBlocks) {
+   while (numBlocks-- > 0) {
+      if ((address[0]&address[1]&address[2]&address[3]) != 0xFFFFFFFFUL) {
+         break;
+      }
+      address += COMPARE_BLOCK_WORDS;
+   }
+   return address;
+}
+
+//! Find first block that differs from buffer
+//!
+//! @param address    Start of range (word aligned)
+//! @param data       Data to compare against (word aligned)
+//! @param numBlocks  Number of blocks to check
+//!
+//! @return Start of first block that differs or end of range if all match
+//!
+const uint32_t *findMismatchBlock(const uint32_t *address, const uint32_t *data, uint32_t numBlocks) {
+   while (numBlocks-- > 0) {
+      if (((address[0]^data[0])|(address[1]^data[1])|(address[2]^data[2])|(address[3]^data[3])) != 0) {
+         break;
+      }
+      address += COMPARE_BLOCK_WORDS;
+      data    += COMPARE_BLOCK_WORDS;
+   }
+   return address;
+}
+
 //! Verify a range of flash against buffer
 //!
 void verifyRange(FlashData_t *flashData) {
@@ -319,6 +604,14 @@ void verifyRange(FlashData_t *flashData) {
    if ((address & 0x01) != 0) {
       setErrorCode(FLASH_ERR_ILLEGAL_PARAMS);
    }
+   // Skip matching blocks quickly when word aligned - remainder is checked a half-word at a time
+   if (((address|(uint32_t)data)&0x03) == 0) {
+      uint32_t skipped = (uint32_t)findMismatchBlock((const uint32_t *)address, (const uint32_t *)data,
+                                                     numHalfWords/(2*COMPARE_BLOCK_WORDS)) - address;
+      address      += skipped;
+      data         += skipped/2;
+      numHalfWords -= skipped/2;
+   }
    // Verify words
    while (numHalfWords-- > 0) {
       if (*(uint16_t *)address != *data)
@@ -395,6 +688,13 @@ void blankCheckRange(FlashData_t *flashData) {
    if ((address & (elementSize-1)) != 0) {
       setErrorCode(FLASH_ERR_ILLEGAL_PARAMS);
    }
+   // Skip blank blocks quickly when word aligned - remainder is checked a half-word at a time
+   if ((address&0x03) == 0) {
+      uint32_t skipped = (uint32_t)findNotBlankBlock((const uint32_t *)address,
+                                                     numElements/(2*COMPARE_BLOCK_WORDS)) - address;
+      address     += skipped;
+      numElements -= skipped/elementSize;
+   }
    while (numElements>0) {
       if ((*(uint16_t *) address) != 0xFFFF) {
          setErrorCode(FLASH_ERR_ERASE_FAILED);
@@ -480,15 +780,22 @@ void entry(void) {
    // No errors so far
    flashData->errorCode = FLASH_ERR_OK;
 
+   initCounters(flashData);
    initFlash(flashData);
 //   unlockFlash(flashData);
 //   lockFlash(flashData);
+   startPhase(flashData, &flashData->counters.eraseTicks);
    eraseFlashBlock(flashData);
    initOptionFlash(flashData);
+   copyRange(flashData);
    eraseRange(flashData);
+   startPhase(flashData, &flashData->counters.blankCheckTicks);
    blankCheckRange(flashData);
    initOptionFlash(flashData);
+   startPhase(flashData, &flashData->counters.programTicks);
    programRange(flashData);
+   fillRange(flashData);
+   startPhase(flashData, &flashData->counters.verifyTicks);
    verifyRange(flashData);
    
    // Indicate completed